@@ -27,6 +27,7 @@
 #include <mutex>
 #include <thread>
 #include <filesystem>
+#include <unordered_set>
 #include <vector>
 #include <json.hpp>
 #include "Config.hpp"
@@ -36,6 +37,9 @@
 #include "util/util.hpp"
 
 namespace castor {
+
+// Fetches the schedule `calendar_horizon` seconds ahead (metadata only: kept, cached and checked for missing files),
+// but hands players only the items starting within `preload_time_file`, so a long lookahead costs no audio memory.
 class Calendar {
 
     const std::string m3uPrefix = "m3u://";
@@ -48,7 +52,8 @@ class Calendar {
     std::mutex mItemsMutex;
     std::mutex mWorkMutex;
     std::condition_variable mWorkCV;
-    std::vector<std::shared_ptr<PlayItem>> mItems;
+    std::vector<std::shared_ptr<PlayItem>> mItems; // within the calendar horizon
+    std::vector<std::shared_ptr<PlayItem>> mScheduled; // within the audio horizon, handed to the callback
     api::ClientYARM mAPIClient;
 
 public:
@@ -56,7 +61,7 @@ public:
     std::function<void(const std::vector<std::shared_ptr<PlayItem>>& items)> calendarChangedCallback;
 
     Calendar(const Config& tConfig) :
-        mStartupTime(std::time(0)),
+        mStartupTime(util::EngineClock::time()),
         mConfig(tConfig),
         mAPIClient(mConfig)
     {}
@@ -77,9 +82,10 @@ public:
                 catch (const std::exception& e) {
                     log.error() << "Calendar refresh failed: " << e.what();
                 }
+                publish(); // items entering the audio horizon, even if the schedule is unchanged
                 auto refreshTime = std::chrono::seconds(mConfig.calendarRefreshInterval);
                 std::unique_lock<std::mutex> lock(mWorkMutex);
-                mWorkCV.wait_for(lock, refreshTime, [this] { return !mRunning.load(std::memory_order_acquire); });
+                util::EngineClock::waitFor(mWorkCV, lock, refreshTime, [this] { return !mRunning.load(std::memory_order_acquire); });
             }
         });
         log.debug() << "Calendar started";
@@ -134,19 +140,53 @@ private:
     }
 
     void storeItems(const std::vector<std::shared_ptr<PlayItem>>& tItems) {
-        std::lock_guard<std::mutex> lock(mItemsMutex);
-        if (std::ranges::equal(tItems, mItems, [](const auto& a, const auto& b) { return *a == *b; })) {
-            log.debug() << "Calendar not changed";
-            return;
+        {
+            std::lock_guard<std::mutex> lock(mItemsMutex);
+            if (std::ranges::equal(tItems, mItems, [](const auto& a, const auto& b) { return *a == *b; })) {
+                log.debug() << "Calendar not changed";
+                return;
+            }
+            log.info(Log::Yellow) << "Calendar changed";
+
+            validate(tItems);
+            mItems = tItems;
+            try {
+                serialize(mItems);
+            } catch (const std::exception& e) {
+                log.error() << "Calendar failed to serialize items: " << e.what();
+            }
         }
-        log.info(Log::Yellow) << "Calendar changed";
+        publish();
+    }
 
-        mItems = std::move(tItems);
-        if (calendarChangedCallback) calendarChangedCallback(mItems);
-        try {
-            serialize(mItems);
-        } catch (const std::exception& e) {
-            log.error() << "Calendar failed to serialize items: " << e.what();
+    // hands the items starting within the audio horizon to the callback if they changed
+    void publish() {
+        std::lock_guard<std::mutex> lock(mItemsMutex);
+        auto horizon = util::EngineClock::time() + mConfig.preloadTimeFile;
+        std::vector<std::shared_ptr<PlayItem>> scheduled;
+        for (const auto& item : mItems) if (item->start <= horizon) scheduled.push_back(item);
+        if (std::ranges::equal(scheduled, mScheduled, [](const auto& a, const auto& b) { return *a == *b; })) return;
+
+        log.debug() << "Calendar scheduling " << scheduled.size() << " of " << mItems.size() << " items";
+        mScheduled = std::move(scheduled);
+        if (calendarChangedCallback) calendarChangedCallback(mScheduled);
+    }
+
+    // warns about local files of new items that don't exist (ahead of the audio horizon, so there's time to fix them)
+    void validate(const std::vector<std::shared_ptr<PlayItem>>& tItems) const {
+        std::unordered_set<std::string> known;
+        for (const auto& item : mItems) known.insert(item->uri);
+        auto check = [&](const PlayItem& item) {
+            const auto& uri = item.uri;
+            if (uri.starts_with("http") || uri.starts_with("line") || !known.insert(uri).second) return;
+            std::error_code ec;
+            if (!std::filesystem::exists(uri, ec)) {
+                log.warn() << "Calendar item '" << uri << "' at " << util::timefmt(item.start, "%Y-%m-%d %H:%M:%S") << " does not exist";
+            }
+        };
+        for (const auto& item : tItems) {
+            check(*item);
+            for (const auto& track : item->tracks) check(*track);
         }
     }
 
@@ -36,6 +36,7 @@ class Castor {
     static constexpr const char* kConfigPath = "./config/config.txt";
 
     bool mRunning = false;
+    bool mFinished = false;
     std::mutex mMutex;
     std::condition_variable mCV;
     std::unique_ptr<Engine> mEngine = nullptr;
@@ -71,15 +72,43 @@ public:
         auto config = Config(std::move(configPath));
         log.setFilePath(config.logPath);
         log.setLevel(config.logLevel);
+        parseHeadlessArgs(args, config);
 
         mEngine = std::make_unique<Engine>(std::move(config));
+        mEngine->finishedCallback = [this] {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mFinished = true;
+            mCV.notify_all();
+        };
         mRunning = true;
         mEngine->parseArgs(std::move(args));
         mEngine->start();
+        bool finished;
         {
             std::unique_lock<std::mutex> lock(mMutex);
-            mCV.wait(lock, [this]{ return !mRunning; });
+            mCV.wait(lock, [this]{ return !mRunning || mFinished; });
+            finished = mRunning && mFinished;
         }
+        if (finished) terminate();
+    }
+
+    // --headless <output file|null> [--duration <sec>] [--speed <factor>] [--start <unix time>]
+    // renders without audio device on a virtual clock starting at --start (default: now)
+    static void parseHeadlessArgs(const std::unordered_map<std::string,std::string>& tArgs, Config& tConfig) {
+        auto arg = [&](const std::string& key) {
+            auto it = tArgs.find(key);
+            return it != tArgs.end() ? it->second : std::string();
+        };
+        tConfig.headlessOutput = arg("--headless");
+        if (tConfig.headlessOutput.empty()) return;
+        if (auto duration = arg("--duration"); duration.size()) tConfig.headlessDuration = std::stod(duration);
+        if (auto speed = arg("--speed"); speed.size()) tConfig.headlessSpeed = std::stod(speed);
+        if (auto start = arg("--start"); start.size()) tConfig.headlessStart = std::stoll(start);
+        tConfig.realtimeRendering = false;
+
+        auto start = tConfig.headlessStart ? std::chrono::system_clock::from_time_t(tConfig.headlessStart) : std::chrono::system_clock::now();
+        util::EngineClock::setVirtual(start);
+        log.info() << "Castor headless mode, virtual clock starts at " << util::timefmt(util::EngineClock::time(), "%Y-%m-%d %H:%M:%S");
     }
 
     void terminate() {
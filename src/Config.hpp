@@ -22,6 +22,7 @@
 
 #pragma once
 
+#include <algorithm>
 #include <fstream>
 #include <sstream>
 #include <string>
@@ -61,6 +62,7 @@ class Config {
     static constexpr const char* kHealthURL = "";
     static constexpr const char* kClockURL = "";
     static constexpr const char* kCalendarRefreshInterval = "60";
+    static constexpr const char* kCalendarHorizon = "0";
     static constexpr const char* kCalendarCachePath = "./cache/calendar.json";
     static constexpr const char* kHealthReportInterval = "60";
     static constexpr const char* kYARMHost = "";
@@ -71,8 +73,25 @@ class Config {
     static constexpr const char* kSilenceStopDuration = "1";
     static constexpr const char* kPreloadTimeFile = "3600";
     static constexpr const char* kPreloadTimeFallback = "3600";
+    static constexpr const char* kPreloadCompact = "0";
+    static constexpr const char* kPlaylistPlayer = "0";
     static constexpr const char* kProgramFadeInTime = "1.0";
     static constexpr const char* kProgramFadeOutTime = "1.0";
+    static constexpr const char* kProgramCrossFadeTime = "0";
+    static constexpr const char* kRenderAheadTime = "2.0";
+    static constexpr const char* kFileStreamThreshold = "900";
+    static constexpr const char* kFileStreamLookahead = "30";
+    static constexpr const char* kFileDecodeThreads = "1";
+    static constexpr const char* kPCMCachePath = "";
+    static constexpr const char* kPCMCacheSize = "4096";
+    static constexpr const char* kBufferHugePages = "0";
+    static constexpr const char* kBufferPrefault = "1";
+    static constexpr const char* kBufferLockAhead = "0";
+    static constexpr const char* kBufferReleaseMargin = "10";
+    static constexpr const char* kLoadThreads = "4";
+    static constexpr const char* kLoadDeviceThreads = "2";
+    static constexpr const char* kPreloadJITFactor = "0";
+    static constexpr const char* kPreloadJITNetworkFloor = "300";
     static constexpr const char* kFallbackCrossFadeTime = "5.0";
     static constexpr const char* kSampleRate = "44100";
     static constexpr const char* kFallbackShuffle = "0";
@@ -129,6 +148,8 @@ public:
 
     int preloadTimeFile;
     int preloadTimeFallback;
+    bool preloadCompact;
+    bool playlistPlayer;
     int preloadTimeStream = 10;
     int preloadTimeLine = 5;
 
@@ -167,6 +188,7 @@ public:
     int webControlPort;
     int logLevel;
     int calendarRefreshInterval;
+    int calendarHorizon;
     int healthReportInterval;
     int silenceThreshold;
     int silenceStartDuration;
@@ -177,9 +199,30 @@ public:
     float outputGain = -9;
     float programFadeInTime;
     float programFadeOutTime;
+    float programCrossFadeTime;
+    float renderAheadTime;
+    float fileStreamThreshold;
+    float fileStreamLookahead;
+    int fileDecodeThreads;
+    std::string pcmCachePath;
+    size_t pcmCacheSize;
+    int bufferHugePages;
+    bool bufferPrefault;
+    float bufferLockAhead;
+    float bufferReleaseMargin;
+    size_t loadThreads;
+    size_t loadDeviceThreads;
+    float preloadJITFactor;
+    float preloadJITNetworkFloor;
     float fallbackCrossFadeTime;
     bool realtimeRendering = true;
 
+    // headless rendering on the virtual engine clock (set from command line arguments)
+    std::string headlessOutput;
+    double headlessDuration = 86400;
+    double headlessSpeed = 0;
+    time_t headlessStart = 0;
+
     std::string parametersPath = "./parameters.json";
 
     static std::string get(Map& map, std::string mapKey, std::string defaultValue) {
@@ -240,9 +283,27 @@ public:
         silenceStartDuration = std::stoi(get(map, "silence_start_duration", kSilenceStartDuration));
         silenceStopDuration = std::stoi(get(map, "silence_stop_duration", kSilenceStopDuration));
         preloadTimeFile = std::stoi(get(map, "preload_time_file", kPreloadTimeFile));
+        calendarHorizon = std::max(std::stoi(get(map, "calendar_horizon", kCalendarHorizon)), preloadTimeFile);
         preloadTimeFallback = std::stoi(get(map, "preload_time_fallback", kPreloadTimeFallback));
+        preloadCompact = std::stoi(get(map, "preload_compact", kPreloadCompact));
+        playlistPlayer = std::stoi(get(map, "playlist_player", kPlaylistPlayer));
         programFadeInTime = std::stof(get(map, "program_fade_in_time", kProgramFadeInTime));
         programFadeOutTime = std::stof(get(map, "program_fade_out_time", kProgramFadeOutTime));
+        programCrossFadeTime = std::stof(get(map, "program_cross_fade_time", kProgramCrossFadeTime));
+        renderAheadTime = std::stof(get(map, "render_ahead_time", kRenderAheadTime));
+        fileStreamThreshold = std::stof(get(map, "file_stream_threshold", kFileStreamThreshold));
+        fileStreamLookahead = std::stof(get(map, "file_stream_lookahead", kFileStreamLookahead));
+        fileDecodeThreads = std::stoi(get(map, "file_decode_threads", kFileDecodeThreads));
+        pcmCachePath = get(map, "pcm_cache_path", kPCMCachePath);
+        pcmCacheSize = std::stoul(get(map, "pcm_cache_size", kPCMCacheSize));
+        bufferHugePages = std::stoi(get(map, "buffer_huge_pages", kBufferHugePages));
+        bufferPrefault = std::stoi(get(map, "buffer_prefault", kBufferPrefault));
+        bufferLockAhead = std::stof(get(map, "buffer_lock_ahead", kBufferLockAhead));
+        bufferReleaseMargin = std::stof(get(map, "buffer_release_margin", kBufferReleaseMargin));
+        loadThreads = std::stoul(get(map, "load_threads", kLoadThreads));
+        loadDeviceThreads = std::stoul(get(map, "load_device_threads", kLoadDeviceThreads));
+        preloadJITFactor = std::stof(get(map, "preload_jit_factor", kPreloadJITFactor));
+        preloadJITNetworkFloor = std::stof(get(map, "preload_jit_network_floor", kPreloadJITNetworkFloor));
         fallbackCrossFadeTime = std::stof(get(map, "fallback_cross_fade_time", kFallbackCrossFadeTime));
         fallbackShuffle = std::stoi(get(map, "fallback_shuffle", kFallbackShuffle));
         fallbackSineSynth = std::stoi(get(map, "fallback_sine_synth", kFallbackSineSynth));
@@ -290,6 +351,7 @@ public:
         << "\n\t healthURL=" << healthURL
         << "\n\t clockURL=" << clockURL
         << "\n\t calendarRefreshInterval=" << calendarRefreshInterval
+        << "\n\t calendarHorizon=" << calendarHorizon
         << "\n\t healthReportInterval=" << healthReportInterval
         << "\n\t calendarCachePath=" << calendarCachePath
         << "\n\t yarmHost=" << yarmHost
@@ -309,8 +371,25 @@ public:
         << "\n\t silenceStopDuration=" << silenceStopDuration
         << "\n\t preloadTimeFile=" << preloadTimeFile
         << "\n\t preloadTimeFallback=" << preloadTimeFallback
+        << "\n\t preloadCompact=" << preloadCompact
+        << "\n\t playlistPlayer=" << playlistPlayer
         << "\n\t programFadeInTime=" << programFadeInTime
         << "\n\t programFadeOutTime=" << programFadeOutTime
+        << "\n\t programCrossFadeTime=" << programCrossFadeTime
+        << "\n\t renderAheadTime=" << renderAheadTime
+        << "\n\t fileStreamThreshold=" << fileStreamThreshold
+        << "\n\t fileStreamLookahead=" << fileStreamLookahead
+        << "\n\t fileDecodeThreads=" << fileDecodeThreads
+        << "\n\t pcmCachePath=" << pcmCachePath
+        << "\n\t pcmCacheSize=" << pcmCacheSize
+        << "\n\t bufferHugePages=" << bufferHugePages
+        << "\n\t bufferPrefault=" << bufferPrefault
+        << "\n\t bufferLockAhead=" << bufferLockAhead
+        << "\n\t bufferReleaseMargin=" << bufferReleaseMargin
+        << "\n\t loadThreads=" << loadThreads
+        << "\n\t loadDeviceThreads=" << loadDeviceThreads
+        << "\n\t preloadJITFactor=" << preloadJITFactor
+        << "\n\t preloadJITNetworkFloor=" << preloadJITNetworkFloor
         << "\n\t fallbackCrossFadeTime=" << fallbackCrossFadeTime
         << "\n\t fallbackSineSynth=" << fallbackSineSynth
         << "\n\t fallbackShuffle=" << fallbackShuffle;
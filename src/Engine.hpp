@@ -26,35 +26,96 @@
 #include <ranges>
 #include <string>
 #include <thread>
+#include <unordered_set>
 #include <vector>
 #include "Config.hpp"
 #include "Calendar.hpp"
+#include "LoadScheduler.hpp"
 #include "io/WebService.hpp"
 #include "io/SMTPSender.hpp"
 #include "api/APIClient.hpp"
 #include "dsp/AudioClient.hpp"
+#include "dsp/HeadlessClient.hpp"
 #include "dsp/LinePlayer.hpp"
 #include "dsp/FilePlayer.hpp"
+#include "dsp/PlaylistPlayer.hpp"
 #include "dsp/StreamPlayer.hpp"
 #include "dsp/FallbackPremix.hpp"
+#include "dsp/MixBus.hpp"
+#include "dsp/RenderAhead.hpp"
+#include "dsp/RenderStats.hpp"
+#include "dsp/Timeline.hpp"
 #include "dsp/SilenceDetector.hpp"
 #include "dsp/Recorder.hpp"
 #include "dsp/StreamOutput.hpp"
 #include "dsp/StreamProvider.hpp"
 #include "util/Log.hpp"
+#include "util/ChunkPool.hpp"
+#include "util/MemoryPages.hpp"
+#include "util/RCUArray.hpp"
+#include "util/Reclaimer.hpp"
+#include "util/RTGuard.hpp"
+#include "util/TimerWheel.hpp"
 #include "util/util.hpp"
 
 namespace castor {
 
 class PlayerFactory {
+    // recyclable file players and the chunks of their sample buffers, shared with the deleters
+    // of the players handed out, so players returned late still find it
+    struct Pool {
+        static constexpr size_t kMaxIdlePlayers = 8;
+        static constexpr size_t kMaxIdleChunks = 64;
+
+        std::shared_ptr<util::ChunkPool> chunks;
+        std::mutex mutex;
+        std::vector<std::unique_ptr<audio::FilePlayer>> players;
+        std::atomic<size_t> created = 0;
+        std::atomic<size_t> reused = 0;
+
+        Pool(util::MemoryPages::HugePages tHugePages, bool tPrefault) :
+            chunks(std::make_shared<util::ChunkPool>(kMaxIdleChunks, tHugePages, tPrefault))
+        {}
+
+        std::unique_ptr<audio::FilePlayer> take() {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (players.empty()) return nullptr;
+            auto player = std::move(players.back());
+            players.pop_back();
+            return player;
+        }
+
+        // deleter of file players: runs on the thread dropping the last reference (usually the reclaimer's)
+        void recycle(audio::FilePlayer* tPlayer) {
+            std::unique_ptr<audio::FilePlayer> player(tPlayer);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (players.size() >= kMaxIdlePlayers) return;
+            }
+            player->recycle();
+            std::lock_guard<std::mutex> lock(mutex);
+            if (players.size() < kMaxIdlePlayers) players.push_back(std::move(player));
+        }
+    };
+
     const audio::AudioStreamFormat& mClientFormat;
     const Config& mConfig;
+    util::Reclaimer& mReclaimer;
+    util::TimerWheel& mScheduler;
+    audio::PCMCache& mPCMCache;
+    audio::SharedPCM& mSharedPCM;
+    std::shared_ptr<Pool> mPool;
     // std::mutex mMutex;
     
 public:
-    PlayerFactory(const audio::AudioStreamFormat& tClientFormat, const Config& tConfig) :
+    PlayerFactory(const audio::AudioStreamFormat& tClientFormat, const Config& tConfig, util::Reclaimer& tReclaimer, util::TimerWheel& tScheduler, audio::PCMCache& tPCMCache, audio::SharedPCM& tSharedPCM) :
         mClientFormat(tClientFormat),
-        mConfig(tConfig)
+        mConfig(tConfig),
+        mReclaimer(tReclaimer),
+        mScheduler(tScheduler),
+        mPCMCache(tPCMCache),
+        mSharedPCM(tSharedPCM),
+        mPool(std::make_shared<Pool>(util::MemoryPages::parseHugePages(tConfig.bufferHugePages), tConfig.bufferPrefault))
     {}
 
     std::shared_ptr<audio::Player> createPlayer(std::shared_ptr<PlayItem> tPlayItem) {
@@ -62,24 +123,72 @@ public:
         auto name = uri.substr(uri.rfind('/')+1);
         // std::lock_guard<std::mutex> lock(mMutex);
         // log.debug(Log::Magenta) << "PlayerFactory createPlayer " << name;
-        if (uri.starts_with("line"))
-            return std::make_shared<audio::LinePlayer>(mClientFormat, name, mConfig.preloadTimeLine, mConfig.programFadeInTime, mConfig.programFadeOutTime);
+        // with a program crossfade, items fade out past their end while the next one fades in
+        auto crossFade = mConfig.programCrossFadeTime > 0;
+        auto fadeInTime = crossFade ? mConfig.programCrossFadeTime : mConfig.programFadeInTime;
+        auto fadeOutTime = crossFade ? mConfig.programCrossFadeTime : mConfig.programFadeOutTime;
+        std::shared_ptr<audio::Player> player;
+        if (!tPlayItem->tracks.empty())
+            player = std::make_shared<audio::PlaylistPlayer>(mClientFormat, name, mConfig.preloadTimeFile, fadeInTime, fadeOutTime, mConfig.fileStreamLookahead);
+        else if (uri.starts_with("line"))
+            player = std::make_shared<audio::LinePlayer>(mClientFormat, name, mConfig.preloadTimeLine, fadeInTime, fadeOutTime);
         else if (uri.starts_with("http"))
-            return std::make_shared<audio::StreamPlayer>(mClientFormat, name, mConfig.preloadTimeStream, mConfig.programFadeInTime, mConfig.programFadeOutTime);
+            player = std::make_shared<audio::StreamPlayer>(mClientFormat, name, mConfig.preloadTimeStream, fadeInTime, fadeOutTime);
         else
-            return std::make_shared<audio::FilePlayer>(mClientFormat, name, mConfig.preloadTimeFile, mConfig.programFadeInTime, mConfig.programFadeOutTime);
+            player = createFilePlayer(name, fadeInTime, fadeOutTime);
+        player->reclaimer = &mReclaimer;
+        player->scheduler = &mScheduler;
+        player->pcmCache = &mPCMCache;
+        player->sharedPCM = &mSharedPCM;
+        player->crossFade = crossFade;
+        return player;
     }
 
+    // hands a player that is no longer visible to the render thread to the reclaimer,
+    // file players are recycled into the pool once the last reference is dropped
     void returnPlayer(std::shared_ptr<audio::Player> tPlayer) {
         // std::lock_guard<std::mutex> lock(mMutex);
+        auto bytes = tPlayer->memorySize();
+        mReclaimer.retire(std::move(tPlayer), bytes);
+    }
+
+    // sample memory of file players, for other buffers to be backed the same way
+    std::shared_ptr<util::ChunkPool> chunkPool() {
+        return mPool->chunks;
+    }
+
+    // returns the memory of idle chunks and free heap pages to the OS (called periodically)
+    void trim() {
+        mPool->chunks->trim();
+        log.debug() << "PlayerFactory players created: " << mPool->created << ", reused: " << mPool->reused << ", shared loads: " << mSharedPCM.hits()
+                    << ", chunks used: " << (mPool->chunks->usedBytes() >> 20) << " MiB, idle: " << (mPool->chunks->freeBytes() >> 20) << " MiB";
+    }
+
+private:
+    std::shared_ptr<audio::Player> createFilePlayer(const std::string& tName, float tFadeInTime, float tFadeOutTime) {
+        auto player = mPool->take();
+        if (player) {
+            player->name = tName;
+            mPool->reused++;
+        } else {
+            player = std::make_unique<audio::FilePlayer>(mClientFormat, tName, mConfig.preloadTimeFile, tFadeInTime, tFadeOutTime, mConfig.fileStreamThreshold, mConfig.fileStreamLookahead, mConfig.preloadCompact, mConfig.fileDecodeThreads, mPool->chunks);
+            mPool->created++;
+        }
+        return std::shared_ptr<audio::FilePlayer>(player.release(), [pool = mPool](audio::FilePlayer* plr) { pool->recycle(plr); });
     }
 };
 
 
 class Engine : public audio::Client::Renderer {
 
+    static constexpr size_t kMaxPlayers = 4096;
+
     const Config mConfig;
     const audio::AudioStreamFormat mClientFormat;
+    util::TimerWheel mScheduler; // drives all player transitions, outlives the players destroyed by the reclaimer
+    util::Reclaimer mReclaimer; // declared early to outlive everything that retires into it
+    audio::PCMCache mPCMCache;
+    audio::SharedPCM mSharedPCM; // decoded items held by players, read by further players of the same file
     std::unique_ptr<Calendar> mCalendar;
     std::unique_ptr<io::SMTPSender> mSMTPSender;
     std::unique_ptr<api::Client> mAPIClient;
@@ -88,9 +197,13 @@ class Engine : public audio::Client::Renderer {
     ctl::Status mStatus;
     std::unique_ptr<io::WebService> mWebService;
     audio::Client mAudioClient;
+    std::unique_ptr<audio::HeadlessClient> mHeadlessClient;
     audio::SilenceDetector mSilenceDet;
     audio::SilenceDetector mInputMeter;
     audio::FallbackPremix mFallback;
+    audio::MixBus mMixBus;
+    audio::Timeline mTimeline;
+    audio::RenderStats mRenderStats;
     audio::Recorder mScheduleRecorder;
     audio::Recorder mBlockRecorder;
     audio::StreamOutput mStreamOutput;
@@ -98,11 +211,15 @@ class Engine : public audio::Client::Renderer {
     std::atomic<bool> mRunning = false;
     std::thread mScheduleThread;
     std::thread mLoadThread;
-    std::atomic<std::deque<std::shared_ptr<audio::Player>>*> mPlayers{};
-    std::deque<std::shared_ptr<audio::Player>> mPlayersBuf1, mPlayersBuf2;
+    std::mutex mPlayersMutex;
+    std::deque<std::shared_ptr<audio::Player>> mPlayers;
+    LoadScheduler mLoader; // declared after the players so its workers are done with them first
+    util::RCUArray<audio::Player, kMaxPlayers> mRenderPlayers;
+    audio::RenderAhead mRenderAhead; // declared after the player queue it reads from
     
     std::shared_ptr<api::Program> mCurrProgram = nullptr;
     util::ManualTimer mEjectTimer;
+    util::ManualTimer mTrimTimer;
     util::AsyncTimer mReportTimer;
     util::AsyncAlignedTimer mBlockRecordTimer;
     util::TaskQueue mPlayerModifyQueue;
@@ -110,14 +227,16 @@ class Engine : public audio::Client::Renderer {
     util::TaskQueue mParamChangeQueue;
     util::TaskQueue mReportQueue;
     util::TaskQueue mMailSendQueue;
-    // audio::Player* mPlayerPtrs[3];
-    // std::atomic<size_t> mPlayerPtrIdx;
     time_t mStartTime;
     float mOutputGainLog = 0.0f;
     std::atomic<float> mOutputGainLin = 1.0f;
     
     
 public:
+
+    std::function<void()> finishedCallback;
+
+
     Engine(Config tConfig) :
         mConfig(tConfig),
         mClientFormat(mConfig.sampleRate, mConfig.samplesPerFrame, 2),
@@ -126,16 +245,22 @@ public:
         mSMTPSender(std::make_unique<io::SMTPSender>()),
         mParameters(mConfig.parametersPath),
         mWebService(std::make_unique<io::WebService>(mConfig.webControlHost, mConfig.webControlPort, mConfig.webControlAuthUser, mConfig.webControlAuthPass, mConfig.webControlAuthToken, mConfig.webControlStatic, mConfig.webControlAudioStream, mParameters, mStatus)),
-        mPlayerFactory(std::make_unique<PlayerFactory>(mClientFormat, mConfig)),
+        mPCMCache(mClientFormat, mConfig.pcmCachePath, static_cast<size_t>(mConfig.pcmCacheSize) << 20),
+        mPlayerFactory(std::make_unique<PlayerFactory>(mClientFormat, mConfig, mReclaimer, mScheduler, mPCMCache, mSharedPCM)),
         mAudioClient(mConfig.iDevName, mConfig.oDevName, mConfig.sampleRate, mConfig.samplesPerFrame),
         mSilenceDet(mClientFormat, mConfig.silenceThreshold, mConfig.silenceStartDuration, mConfig.silenceStopDuration),
         mInputMeter(mClientFormat, 0, 0, 0),
-        mFallback(mClientFormat, mConfig.audioFallbackPath, mConfig.preloadTimeFallback, mConfig.fallbackCrossFadeTime, mConfig.fallbackShuffle, mConfig.fallbackSineSynth),
+        mFallback(mClientFormat, mConfig.audioFallbackPath, mConfig.preloadTimeFallback, mConfig.fallbackCrossFadeTime, mConfig.fallbackShuffle, mConfig.fallbackSineSynth, mConfig.preloadCompact, mPlayerFactory->chunkPool()),
+        mTimeline(mClientFormat),
+        mRenderStats(mClientFormat),
+        mLoader(mConfig.loadThreads, mConfig.loadDeviceThreads, mConfig.preloadJITFactor, mConfig.preloadJITNetworkFloor),
+        mRenderAhead(mClientFormat, mConfig.renderAheadTime),
         mScheduleRecorder(mClientFormat, mConfig.recordScheduleBitRate),
         mBlockRecorder(mClientFormat, mConfig.recordBlockBitRate),
         mStreamOutput(mClientFormat, mConfig.streamOutBitRate),
         mStreamProvider(mClientFormat, 128000),
         mEjectTimer(1),
+        mTrimTimer(60),
         mReportTimer(mConfig.healthReportInterval),
         mBlockRecordTimer(mConfig.recordBlockDuration),
         mStartTime(std::time(0))
@@ -143,11 +268,20 @@ public:
         mCalendar->calendarChangedCallback = [this](const auto& items) { onCalendarChanged(items); };
         mSilenceDet.silenceChangedCallback = [this](const auto& silence) { onSilenceChanged(silence); };
         mFallback.startCallback = [this](auto itm) { onPlayerStart(itm); };
+        mFallback.setCache(&mPCMCache);
+        mMixBus.addVoice(mFallback);
+        mRenderAhead.playersCallback = [this] { return getPlayers(); };
         mReportTimer.callback = [this] { onReportStatus(); };
         mBlockRecordTimer.callback = [this] { onRecordBlockChanged(); };
         mParameters.onParametersChanged = [this] { onParametersChanged(); };
         mParameters.publish();
         mAudioClient.setRenderer(this);
+        if (!mConfig.realtimeRendering) {
+            mHeadlessClient = std::make_unique<audio::HeadlessClient>(mClientFormat, mConfig.headlessOutput, mConfig.headlessDuration, mConfig.headlessSpeed);
+            mHeadlessClient->setRenderer(this);
+            mHeadlessClient->readyCallback = [this] { return isCaughtUp(); };
+            mHeadlessClient->finishedCallback = [this] { if (finishedCallback) finishedCallback(); };
+        }
         mScheduleRecorder.logName = "Schedule Recorder";
         mBlockRecorder.logName = "Block Recorder";
         mWebService->audioStreamBuffer = &mStreamProvider.mRingBufferO;
@@ -165,9 +299,12 @@ public:
 
     void start() {
         log.debug() << "Engine starting...";
+        log.info() << "Engine using " << audio::kernels::isa() << " DSP kernels";
+        util::RTGuard::install();
         mRunning = true;        
-        mAudioClient.start(mConfig.realtimeRendering);
+        if (!mHeadlessClient) mAudioClient.start(true);
         mFallback.run();
+        mRenderAhead.start();
         mCalendar->start();
         mScheduleThread = std::thread(&Engine::runSchedule, this);
         mLoadThread = std::thread(&Engine::runLoad, this);
@@ -188,6 +325,8 @@ public:
             log.error() << "Engine failed to start output stream: " << e.what();
         }
 
+        if (mHeadlessClient) mHeadlessClient->start(); // renders once everything is running
+
         log.info() << "Engine started";
 
         mWebService->start();
@@ -201,29 +340,44 @@ public:
         mReportTimer.stop();
         if (mScheduleThread.joinable()) mScheduleThread.join();
         if (mLoadThread.joinable()) mLoadThread.join();
+        mLoader.stop();
         mScheduleRecorder.stop();
         mBlockRecorder.stop();
         mFallback.terminate();
-        for (const auto& player : mPlayersBuf1) player->stop();
-        for (const auto& player : mPlayersBuf2) player->stop();
+        mRenderAhead.stop();
+        for (const auto& player : getPlayers()) player->stop();
         mStreamOutput.stop();
         mStreamProvider.stop();
+        if (mHeadlessClient) mHeadlessClient->stop();
         mAudioClient.stop();
         log.info() << "Engine stopped";
     }
 
 
-    // thread-safe getter and setter for player queue
+    // thread-safe getter and setter for player queue (non-realtime threads)
     std::deque<std::shared_ptr<audio::Player>> getPlayers() {
-        auto playersPtr = mPlayers.load(std::memory_order_acquire);
-        if (!playersPtr) return {};
-        return *playersPtr;
+        std::lock_guard<std::mutex> lock(mPlayersMutex);
+        return mPlayers;
     }
 
-    void setPlayers(const std::deque<std::shared_ptr<audio::Player>>& tPlayers) {
-        auto inactiveBuffer = (mPlayers.load() == &mPlayersBuf1) ? &mPlayersBuf2 : &mPlayersBuf1;
-        *inactiveBuffer = tPlayers;
-        mPlayers.store(inactiveBuffer, std::memory_order_release);
+    // publishes a new player generation to the render thread; callers are serialized by mPlayerModifyQueue
+    void setPlayers(std::deque<std::shared_ptr<audio::Player>> tPlayers) {
+        std::deque<std::shared_ptr<audio::Player>> retired;
+        {
+            std::lock_guard<std::mutex> lock(mPlayersMutex);
+            retired = std::exchange(mPlayers, std::move(tPlayers));
+        }
+        auto published = mRenderPlayers.publish(mPlayers);
+        if (published < mPlayers.size()) {
+            log.warn() << "Engine render queue full - publishing " << published << " of " << mPlayers.size() << " players";
+        }
+
+        // render thread left the previous generation, dropped players are destroyed in the background
+        std::unordered_set<audio::Player*> kept;
+        for (const auto& player : mPlayers) kept.insert(player.get());
+        for (auto& player : retired) {
+            if (!kept.contains(player.get())) mPlayerFactory->returnPlayer(std::move(player));
+        }
     }
     
 
@@ -236,20 +390,63 @@ public:
                 });
             }
 
+            if (mTrimTimer.query()) {
+                mPlayerModifyQueue.async([this] {
+                    mPlayerFactory->trim();
+                });
+            }
+
+            if (mConfig.bufferLockAhead > 0) {
+                lockBuffers();
+            }
+
+            if (mConfig.bufferReleaseMargin > 0) {
+                releasePlayedBuffers();
+            }
+
+            prefetchBuffers();
+
             if (mWebService->isClientConnected()) {
                 updateWebService();
             }
 
-            std::this_thread::sleep_for(std::chrono::milliseconds(500));
+            util::RTGuard::report();
+
+            util::EngineClock::sleepFor(std::chrono::milliseconds(500));
         }
     }
 
+    // keeps the samples about to be rendered by queued players and the fallback locked in RAM
+    void lockBuffers() {
+        util::MemoryPages::retryLock();
+        auto ahead = static_cast<size_t>(mConfig.bufferLockAhead * mClientFormat.sampleRate) * mClientFormat.channelCount;
+        for (const auto& player : getPlayers()) {
+            auto state = player->getState();
+            auto pending = player->isLoaded && (state == audio::Player::WAIT || state == audio::Player::CUED || state == audio::Player::PLAY);
+            player->lockBuffer(pending ? ahead : 0);
+        }
+        mFallback.lockBuffer(ahead);
+    }
+
+    // reads cached files mapped by the players in ahead of playback, so rendering them doesn't wait for the disk
+    void prefetchBuffers() {
+        auto ahead = static_cast<size_t>(mConfig.fileStreamLookahead * mClientFormat.sampleRate) * mClientFormat.channelCount;
+        for (const auto& player : getPlayers()) player->prefetchBuffer(ahead);
+    }
+
+    // returns the memory of samples played more than the margin ago, so long items shrink while playing
+    void releasePlayedBuffers() {
+        auto margin = static_cast<size_t>(mConfig.bufferReleaseMargin * mClientFormat.sampleRate) * mClientFormat.channelCount;
+        for (const auto& player : getPlayers()) player->releasePlayed(margin);
+        mFallback.releasePlayed(margin);
+    }
+
     void cleanPlayers() {
         auto players = getPlayers();
         while (players.size() && players.front()->isFinished()) {
             players.pop_front();
         }
-        setPlayers(players);
+        setPlayers(std::move(players));
     }
 
     void schedulePlayers(std::vector<std::shared_ptr<PlayItem>> tScheduleItems) {
@@ -264,7 +461,7 @@ public:
 
         // push existing players matching new play items
         for (const auto& item : tScheduleItems) {
-            if (item->end < std::time(0)) continue;
+            if (item->end < util::EngineClock::time()) continue;
 
             auto it = std::find_if(oldPlayers.begin(), oldPlayers.end(), [&](const auto& plr) { return itemsEqual(plr->playItem, item); });
             if (it != oldPlayers.end()) {
@@ -272,12 +469,14 @@ public:
             } else {
                 auto player = mPlayerFactory->createPlayer(item);
                 player->startCallback = [this](auto itm) { this->onPlayerStart(itm); };
+                player->transitionCallback = [this, plr = player.get()](auto transition, auto time) { return mTimeline.post(plr, transition, time); };
                 player->schedule(item);
                 newPlayers.push_back(player);
             }
         }
         
-        // stop players not matching new play items
+        // stop players not matching new play items (cancelling their loads, so the buffers return to the pool)
+        mLoader.reschedule(newPlayers);
         for (const auto& player : oldPlayers) {
             auto it = std::find_if(tScheduleItems.begin(), tScheduleItems.end(), [&](const auto& itm) { return itemsEqual(itm, player->playItem); });
             if (it == tScheduleItems.end()) {
@@ -285,21 +484,34 @@ public:
             }
         }
 
-        setPlayers(newPlayers);
+        setPlayers(std::move(newPlayers));
     }
 
 
-    // load thread (serial for each player)
+    // headless driver: all timers due and all items starting within the transition lead time are done,
+    // and no streaming item is about to outrun its decoder
+    bool isCaughtUp() {
+        if (!mScheduler.isCurrent()) return false;
+        auto horizon = util::EngineClock::Clock::to_time_t(util::EngineClock::now() + audio::Player::kTransitionLeadTime) + 1;
+        for (const auto& player : getPlayers()) {
+            if (player->isLoadPending(horizon) || player->isStarved()) return false;
+        }
+        return true;
+    }
+
+
+    // load thread (hands due players to the load scheduler, which orders them by start time
+    // and with just-in-time loading delays them until their estimated load time is left)
     void runLoad() {
         while (mRunning) {
             auto players = getPlayers();
             for (const auto& player : players) {
-                if (player && player->needsLoad()) {
-                    player->tryLoad();
+                if (player && player->needsLoad() && mLoader.isDue(*player)) {
+                    mLoader.submit(player);
                 }
             }
             
-            std::this_thread::sleep_for(std::chrono::milliseconds(250));
+            util::EngineClock::sleepFor(std::chrono::milliseconds(250));
         }
     }
 
@@ -359,6 +571,8 @@ public:
             if (outGainLog != mOutputGainLog) {
                 mOutputGainLog = outGainLog;
                 mOutputGainLin = util::dbLinear(mOutputGainLog);
+                mRenderAhead.setGain(mOutputGainLin);
+                mSilenceDet.setGain(mOutputGainLin);
                 log.info() << "Engine output gain changed to " << mOutputGainLog << " dB / " << mOutputGainLin << " linear";
             }
         });
@@ -417,6 +631,14 @@ public:
         for (auto player : players) if (player) j += player->getStatusJSON();
         mStatus.players = j;
         mStatus.fallbackActive = mFallback.isActive();
+        mStatus.reclaimPendingBytes = mReclaimer.pendingBytes();
+        mStatus.reclaimedBytes = mReclaimer.retiredBytes();
+        mStatus.lockedBytes = util::MemoryPages::lockedBytes();
+        mStatus.load = mLoader.getJSON();
+        mStatus.cpuLoad = mRenderStats.load();
+        mStatus.render = mRenderStats.getJSON();
+        mStatus.xruns = mAudioClient.getXRunsJSON();
+        mStatus.rtGuard = util::RTGuard::getJSON();
     }
 
 
@@ -442,7 +664,21 @@ public:
                 {"uptime", uptime},
                 {"queue", players.size()},
                 {"rms", rms},
-                {"fallback", mFallback.isActive()}
+                {"fallback", mFallback.isActive()},
+                {"voices", mMixBus.activeVoices()},
+                {"renderAhead", mRenderAhead.bufferedFrames()},
+                {"renderAheadUnderruns", mRenderAhead.underruns()},
+                {"lateTransitions", mTimeline.lateEvents()},
+                {"timers", mScheduler.size()},
+                {"cpuLoad", mRenderStats.averageLoad()},
+                {"cpuLoadPeak", mRenderStats.peakLoad()},
+                {"renderOverruns", mRenderStats.overruns()},
+                {"xruns", mAudioClient.getXRunsJSON()},
+                {"rtViolations", util::RTGuard::violations()},
+                {"reclaimPending", mReclaimer.pendingBytes()},
+                {"reclaimed", mReclaimer.retiredBytes()},
+                {"locked", util::MemoryPages::lockedBytes()},
+                {"load", mLoader.getJSON()}
             };
             
             mAPIClient->postHealth({true, util::currTimeFmtMs(), j.dump()});
@@ -472,45 +708,65 @@ public:
     // realtime thread or called by manual render function
     
     void renderCallback(const audio::sam_t* in,  audio::sam_t* out, size_t nframes) override {
+        static thread_local bool denormalsFlushed = false;
+        if (!denormalsFlushed) {
+            audio::kernels::flushDenormals();
+            denormalsFlushed = true;
+        }
+
+        using Stage = audio::RenderStats::Stage;
+        mRenderStats.begin();
+
         memset(out, 0, nframes * mClientFormat.channelCount * sizeof(audio::sam_t));
 
         mInputMeter.process(in, nframes);
-
-        auto players = getPlayers();
-        for (const auto& player : players) {
-            if (player && player->isPlaying()) {
-                player->process(in, out, nframes);
-                break;
+        mRenderStats.lap(Stage::INPUT_METER);
+
+        // output gain is applied per voice (and baked into rendered-ahead audio)
+        auto outputGain = mOutputGainLin.load(std::memory_order_relaxed);
+        {
+            // the block is split at the frames of scheduled transitions
+            const size_t nch = mClientFormat.channelCount;
+            auto players = mRenderPlayers.read();
+            mTimeline.begin(nframes);
+            for (size_t pos = 0; pos < nframes;) {
+                auto len = mTimeline.dispatch(players, pos, nframes);
+                auto renderedAhead = mRenderAhead.acquire(players);
+                mMixBus.mixProgram(players, in + pos * nch, out + pos * nch, len, outputGain, renderedAhead);
+                mRenderAhead.mix(players, in + pos * nch, out + pos * nch, len, outputGain);
+                pos += len;
             }
+            mTimeline.end(nframes);
         }
+        mRenderStats.lap(Stage::PLAYERS);
 
         mSilenceDet.process(out, nframes);
-        mFallback.process(in, out, nframes);
-
-        if (mOutputGainLin != 1.0f) {
-            for (auto i = 0; i < nframes; ++i) {
-                auto iL = i * mClientFormat.channelCount;
-                auto iR = iL + 1;
-                out[iL] *= mOutputGainLin;
-                out[iR] *= mOutputGainLin;
-            }
-        }
+        mRenderStats.lap(Stage::SILENCE_DETECTOR);
+
+        mMixBus.mixVoices(in, out, nframes, outputGain);
+        mRenderStats.lap(Stage::FALLBACK);
 
         if (mScheduleRecorder.isRunning()) {
             mScheduleRecorder.process(out, nframes);
+            mRenderStats.lap(Stage::SCHEDULE_RECORDER);
         }
 
         if (mBlockRecorder.isRunning()) {
             mBlockRecorder.process(out, nframes);
+            mRenderStats.lap(Stage::BLOCK_RECORDER);
         }
 
         if (mStreamOutput.isRunning()) {
             mStreamOutput.process(out, nframes);
+            mRenderStats.lap(Stage::STREAM_OUTPUT);
         }
 
         if (mStreamProvider.isRunning()) {
             mStreamProvider.process(out, nframes);
+            mRenderStats.lap(Stage::STREAM_PROVIDER);
         }
+
+        mRenderStats.end(nframes);
     }
 
 };
@@ -0,0 +1,326 @@
+/*
+ *  Copyright (C) 2024-2025 Christoph Pastl
+ *
+ *  This file is part of Castor.
+ *
+ *  Castor is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Castor is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ *  If you use this program over a network, you must also offer access
+ *  to the source code under the terms of the GNU Lesser General Public License.
+ */
+
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <json.hpp>
+#include "dsp/AudioProcessor.hpp"
+#include "util/EngineClock.hpp"
+#include "util/Log.hpp"
+
+namespace castor {
+
+// Loads players on a pool of workers, earliest start (deadline) first.
+// At most tDeviceLoads loads read from the same storage device (mount point or stream host) at once, and
+// players of the same URI are loaded one after another, so later ones find the samples already decoded.
+// An urgent job (starting within kUrgentSlack or already playing) that can't be dispatched cancels the
+// running background load with the latest start, which is queued again.
+// Jobs are tagged with the schedule generation they were submitted in; a new schedule drops the jobs
+// of players no longer scheduled and cancels their loads.
+// With a tJITFactor > 0, items are loaded just in time: the decode throughput (audio sec. per sec.) is measured
+// per device and file type, and an item is due once its estimated load time, times tJITFactor, is left until
+// its start (at least kMinLeadTime, tNetworkFloor for network filesystems; not measured yet: the preload time).
+class LoadScheduler {
+    static constexpr time_t kUrgentSlack = 30; // sec. before the start
+    static constexpr time_t kBackgroundSlack = 300; // sec. before the start, loads further ahead may be preempted
+    static constexpr double kMinLeadTime = 60; // sec. before the start, loads begin no later
+    static constexpr double kThroughputWeight = 0.3; // of a new measurement in the moving average
+
+    struct Device {
+        std::string name;
+        bool remote;
+    };
+
+    struct Mount {
+        std::string target;
+        bool remote;
+    };
+
+    struct Job {
+        std::shared_ptr<audio::Player> player;
+        uint64_t id; // the player is renewed when recycled
+        time_t deadline;
+        std::string device;
+        std::string profile; // device and file type, throughput measured for
+        std::string uri;
+        uint64_t generation;
+        bool preempted = false;
+    };
+
+    const size_t mDeviceLoads;
+    const double mJITFactor;
+    const double mNetworkFloor;
+    std::vector<Mount> mMounts; // longest mount point first
+    std::unordered_map<std::string, double> mThroughput; // by profile
+    std::mutex mMutex;
+    std::condition_variable mCV;
+    std::vector<Job> mQueue; // ordered by deadline
+    std::unordered_map<uint64_t, Job> mRunning; // by player id
+    std::unordered_map<std::string, size_t> mDevices; // running loads per device
+    uint64_t mGeneration = 0;
+    std::atomic<bool> mRunningState = true;
+    std::vector<std::thread> mWorkers;
+
+    std::atomic<size_t> mLoads = 0;
+    std::atomic<size_t> mLateLoads = 0; // started after their deadline
+    std::atomic<size_t> mPreemptions = 0;
+    std::atomic<size_t> mObsoleteLoads = 0; // dropped or cancelled by a new schedule
+    std::atomic<time_t> mLastSlack = 0; // of the last load started
+
+public:
+    LoadScheduler(size_t tWorkers, size_t tDeviceLoads, double tJITFactor = 0, double tNetworkFloor = 0) :
+        mDeviceLoads(std::max(tDeviceLoads, size_t(1))),
+        mJITFactor(tJITFactor),
+        mNetworkFloor(tNetworkFloor),
+        mMounts(readMounts())
+    {
+        for (size_t i = 0; i < std::max(tWorkers, size_t(1)); ++i) mWorkers.emplace_back(&LoadScheduler::run, this);
+    }
+
+    ~LoadScheduler() {
+        stop();
+    }
+
+    // cancels running loads and drops queued ones
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            if (!mRunningState) return;
+            mRunningState = false;
+            mQueue.clear();
+            for (const auto& [id, job] : mRunning) job.player->cancelLoad();
+        }
+        mCV.notify_all();
+        for (auto& worker : mWorkers) if (worker.joinable()) worker.join();
+    }
+
+    // queues a player due for loading (ignored if queued or loading already)
+    void submit(std::shared_ptr<audio::Player> tPlayer) {
+        if (!tPlayer || !tPlayer->playItem) return;
+        auto id = tPlayer->id;
+        auto uri = tPlayer->playItem->uri;
+        auto deadline = tPlayer->playItem->start;
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            if (!mRunningState) return;
+            auto queued = mRunning.contains(id) || std::any_of(mQueue.begin(), mQueue.end(), [&](const auto& job) { return job.player->id == id; });
+            if (!queued) {
+                auto device = deviceOf(uri);
+                enqueue({std::move(tPlayer), id, deadline, device.name, profileOf(device, uri), uri, mGeneration});
+            }
+            preempt(); // urgency grows while a job waits
+        }
+        mCV.notify_one();
+    }
+
+    // true once the load of a player should begin (always without just-in-time loading)
+    bool isDue(const audio::Player& tPlayer) {
+        if (mJITFactor <= 0 || !tPlayer.playItem) return true;
+        auto work = tPlayer.loadWork();
+        if (work <= 0) return true;
+        auto device = deviceOf(tPlayer.playItem->uri);
+        double lead;
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            auto it = mThroughput.find(profileOf(device, tPlayer.playItem->uri));
+            if (it == mThroughput.end()) return true;
+            lead = std::max(work / it->second * mJITFactor, kMinLeadTime);
+        }
+        if (device.remote) lead = std::max(lead, mNetworkFloor);
+        return util::EngineClock::time() >= tPlayer.playItem->start - static_cast<time_t>(std::ceil(lead));
+    }
+
+    // starts a new schedule generation with tPlayers, the jobs of all others are dropped and their loads cancelled
+    template <typename Players>
+    void reschedule(const Players& tPlayers) {
+        std::unordered_set<uint64_t> ids;
+        for (const auto& player : tPlayers) if (player) ids.insert(player->id);
+        std::lock_guard<std::mutex> lock(mMutex);
+        ++mGeneration;
+        auto obsolete = std::erase_if(mQueue, [&](const Job& job) { return !ids.contains(job.id); });
+        for (auto& job : mQueue) job.generation = mGeneration;
+        for (auto& [id, job] : mRunning) {
+            if (ids.contains(id)) {
+                job.generation = mGeneration;
+            } else {
+                job.player->cancelLoad();
+                ++obsolete;
+            }
+        }
+        mObsoleteLoads += obsolete;
+        if (obsolete) log.debug() << "LoadScheduler dropped " << obsolete << " obsolete loads";
+    }
+
+    // slack: seconds until the start of the most urgent queued item (negative if late, 0 if none is queued)
+    nlohmann::json getJSON() {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return {
+            {"queued", mQueue.size()},
+            {"running", mRunning.size()},
+            {"slack", mQueue.empty() ? 0 : mQueue.front().deadline - util::EngineClock::time()},
+            {"lastSlack", mLastSlack.load()},
+            {"loads", mLoads.load()},
+            {"lateLoads", mLateLoads.load()},
+            {"preemptions", mPreemptions.load()},
+            {"obsolete", mObsoleteLoads.load()},
+            {"throughput", mThroughput}
+        };
+    }
+
+private:
+    // queued by deadline; an earlier cancel of the player (e.g. a preemption) is cleared here rather than by the load,
+    // so that a cancel arriving between queueing and loading is kept (mutex held)
+    void enqueue(Job&& tJob) {
+        tJob.player->resetLoadCancel();
+        auto pos = std::upper_bound(mQueue.begin(), mQueue.end(), tJob.deadline, [](time_t d, const Job& j) { return d < j.deadline; });
+        mQueue.insert(pos, std::move(tJob));
+    }
+
+    // first queued job whose device and URI are free (mutex held)
+    std::vector<Job>::iterator next() {
+        return std::find_if(mQueue.begin(), mQueue.end(), [this](const Job& job) {
+            if (mDevices[job.device] >= mDeviceLoads) return false;
+            return std::none_of(mRunning.begin(), mRunning.end(), [&](const auto& running) { return running.second.uri == job.uri; });
+        });
+    }
+
+    // makes room for the most urgent job if it waits for a worker or its device (mutex held)
+    void preempt() {
+        if (mQueue.empty()) return;
+        auto now = util::EngineClock::time();
+        const auto& urgent = mQueue.front();
+        if (urgent.deadline - now > kUrgentSlack) return;
+        auto deviceFull = mDevices[urgent.device] >= mDeviceLoads;
+        if (!deviceFull && mRunning.size() < mWorkers.size()) return;
+        Job* victim = nullptr;
+        for (auto& [id, job] : mRunning) {
+            if (job.preempted || job.deadline - now <= kBackgroundSlack) continue;
+            if (deviceFull && job.device != urgent.device) continue;
+            if (!victim || job.deadline > victim->deadline) victim = &job;
+        }
+        if (!victim) return;
+        log.info() << "LoadScheduler preempting load of " << victim->uri << " for " << urgent.uri;
+        victim->preempted = true;
+        victim->player->cancelLoad();
+        mPreemptions++;
+    }
+
+    void run() {
+        std::unique_lock<std::mutex> lock(mMutex);
+        while (mRunningState) {
+            auto it = next();
+            if (it == mQueue.end()) {
+                mCV.wait(lock);
+                continue;
+            }
+            auto job = std::move(*it);
+            mQueue.erase(it);
+            auto player = job.player;
+            auto id = job.id;
+            mDevices[job.device]++;
+            mRunning.emplace(id, job);
+            lock.unlock();
+
+            auto slack = job.deadline - util::EngineClock::time();
+            mLastSlack = slack;
+            mLoads++;
+            if (slack < 0) mLateLoads++;
+            auto begin = std::chrono::steady_clock::now();
+            auto loaded = player->id == id && player->needsLoad() && player->tryLoad();
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+            double decoded = loaded ? player->decodedDuration.load() : 0;
+
+            lock.lock();
+            if (decoded > 0 && elapsed.count() > 0) measure(job.profile, decoded / elapsed.count());
+            auto& running = mRunning.at(id);
+            auto requeue = !loaded && running.preempted && running.generation == mGeneration && mRunningState;
+            job.generation = running.generation;
+            mRunning.erase(id);
+            mDevices[job.device]--;
+            if (requeue) {
+                job.preempted = false;
+                enqueue(std::move(job));
+            }
+            mCV.notify_all();
+        }
+    }
+
+    // mutex held
+    void measure(const std::string& tProfile, double tThroughput) {
+        auto [it, inserted] = mThroughput.try_emplace(tProfile, tThroughput);
+        if (!inserted) it->second += (tThroughput - it->second) * kThroughputWeight;
+    }
+
+    // the mount point holding a file (longest match in the mount table) or the host of a stream
+    Device deviceOf(const std::string& tURI) const {
+        if (tURI.starts_with("http")) {
+            auto begin = tURI.find("://");
+            begin = begin == std::string::npos ? 0 : begin + 3;
+            return {tURI.substr(0, tURI.find('/', begin)), true};
+        }
+        if (tURI.starts_with("line")) return {"line", false};
+        auto path = std::filesystem::absolute(tURI).string();
+        for (const auto& mount : mMounts) {
+            const auto& target = mount.target;
+            if (path.starts_with(target) && (path.size() == target.size() || path[target.size()] == '/' || target == "/")) return {target, mount.remote};
+        }
+        return {"/", false};
+    }
+
+    static std::string profileOf(const Device& tDevice, const std::string& tURI) {
+        return tDevice.name + ":" + std::filesystem::path(tURI).extension().string();
+    }
+
+    static std::vector<Mount> readMounts() {
+        static const std::unordered_set<std::string> kRemoteTypes = {"nfs", "nfs4", "cifs", "smb3", "smbfs", "9p", "ceph", "glusterfs", "davfs", "fuse.sshfs", "fuse.rclone", "fuse.s3fs"};
+        std::vector<Mount> mounts;
+        std::ifstream file("/proc/self/mounts");
+        std::string line;
+        while (std::getline(file, line)) {
+            std::istringstream fields(line);
+            std::string source, target, type;
+            fields >> source >> target >> type;
+            if (!target.empty()) mounts.push_back({target, kRemoteTypes.contains(type)});
+        }
+        std::reverse(mounts.begin(), mounts.end()); // the last mount on a path hides earlier ones
+        std::stable_sort(mounts.begin(), mounts.end(), [](const Mount& a, const Mount& b) { return a.target.size() > b.target.size(); });
+        return mounts;
+    }
+};
+
+}
@@ -22,7 +22,9 @@
 
 #pragma once
 
+#include <algorithm>
 #include <ranges>
+#include <vector>
 #include <json.hpp>
 #include "../dsp/CodecBase.hpp"
 
@@ -129,9 +131,11 @@ struct PlayItem {
     std::string uri;
     std::shared_ptr<api::Program> program = nullptr;
     std::unique_ptr<audio::Metadata> metadata = nullptr;
+    std::vector<std::shared_ptr<PlayItem>> tracks = {}; // of a playlist block, played by one player
 
     bool operator==(const PlayItem& item) const {
-        return item.start == this->start && item.end == this->end && item.uri == this->uri;
+        return item.start == this->start && item.end == this->end && item.uri == this->uri
+            && std::ranges::equal(item.tracks, this->tracks, [](const auto& a, const auto& b) { return *a == *b; });
     }
 
     bool operator<(const PlayItem& item) const {
@@ -139,12 +143,15 @@ struct PlayItem {
     }
 };
 
+void to_json(nlohmann::json& j, const std::vector<std::shared_ptr<PlayItem>>& v);
+
 void to_json(nlohmann::json& j, const PlayItem& p) {
     j = nlohmann::json {
         {"start", p.start},
         {"end", p.end},
         {"uri", p.uri}
     };
+    if (!p.tracks.empty()) to_json(j["tracks"], p.tracks);
 }
 
 void to_json(nlohmann::json& j, const std::shared_ptr<PlayItem>& p) {
@@ -155,10 +162,13 @@ void to_json(nlohmann::json& j, const std::vector<std::shared_ptr<PlayItem>>& v)
     j = std::vector<nlohmann::json>(v.begin(), v.end());
 }
 
+void from_json(const nlohmann::json& j, std::vector<std::shared_ptr<PlayItem>>& v);
+
 void from_json(const nlohmann::json& j, PlayItem& p) {
     j.at("start").get_to(p.start);
     j.at("end").get_to(p.end);
     j.at("uri").get_to(p.uri);
+    if (j.contains("tracks")) from_json(j.at("tracks"), p.tracks);
 }
 
 void from_json(const nlohmann::json& j, std::vector<std::shared_ptr<PlayItem>>& v) {
@@ -51,7 +51,7 @@ public:
     std::vector<std::shared_ptr<api::Program>> getProgram(time_t duration = 0) {
         auto url = mConfig.programURL + "?includeVirtual=true";
         if (duration > 0) {
-            auto now = std::time(nullptr);
+            auto now = util::EngineClock::time();
             auto end = now + duration;
             auto endfmt = util::utcFmt(end);
             url += "&end=" + endfmt;
@@ -124,8 +124,8 @@ public:
     std::vector<std::shared_ptr<PlayItem>> fetchItems() {
         std::vector<std::shared_ptr<PlayItem>> items;
         // m3uParser.reset();
-        const auto now = std::time(0);
-        const auto program = getProgram(mConfig.preloadTimeFile);
+        const auto now = util::EngineClock::time();
+        const auto program = getProgram(mConfig.calendarHorizon);
         for (const auto& pr : program) {
             // log.debug() << pr.start << " - " << pr.end << " Show: " << pr.showName << ", Episode: " << pr.episodeTitle;
             if (pr->mediaId <= 0) {
@@ -154,11 +154,17 @@ public:
                     try {
                         // log.debug() << "Calendar parsing m3u " << uri;
                         auto m3u = mM3uParser.parse(uri, itemStart, itemEnd);
-                        if (!m3u.empty()) {
+                        if (!m3u.empty() && mConfig.playlistPlayer) {
+                            // one item for the whole block, its tracks played by a single player
+                            auto block = std::make_shared<PlayItem>(itemStart, m3u.back()->end, uri, pr);
+                            for (const auto& itm : m3u) itm->program = pr;
+                            block->tracks = m3u;
+                            items.emplace_back(block);
+                        } else if (!m3u.empty()) {
                             // auto prPtr = std::make_shared<api::Program>(pr);
                             // for (auto& itm : m3u) itm.program = prPtr;
                             // items.insert(items.end(), m3u.begin(), m3u.end());
-                            auto maxEnd = std::time(0) + mConfig.preloadTimeFile;
+                            auto maxEnd = util::EngineClock::time() + mConfig.calendarHorizon;
                             for (const auto& itm : m3u) {
                                 if (itm->end <= maxEnd) {
                                     itm->program = pr;
@@ -58,9 +58,9 @@ public:
 
     
     std::vector<std::shared_ptr<PlayItem>> fetchItems() {
-        auto now = std::time(0);
+        auto now = util::EngineClock::time();
         auto frstr = std::to_string(now * 1000);
-        auto tostr = std::to_string((now + mConfig.preloadTimeFile) * 1000);
+        auto tostr = std::to_string((now + mConfig.calendarHorizon) * 1000);
         auto rows = mMySQLClient->query("SELECT t1, t2, PlayerValue FROM YARMProgramTable WHERE t2 >= " + frstr + " AND t2 <= " + tostr + " ORDER BY t1, t2 ASC;");
         std::vector<std::shared_ptr<PlayItem>> items;
         for (const auto& row : rows) {
@@ -74,7 +74,14 @@ public:
             if (url.ends_with("m3u")) {
                 try {
                     auto m3u = mM3uParser.parse(url, t1_ts, t2_ts);
-                    auto maxEnd = std::time(0) + mConfig.preloadTimeFile;
+                    if (!m3u.empty() && mConfig.playlistPlayer) {
+                        // one item for the whole block, its tracks played by a single player
+                        auto block = std::make_shared<PlayItem>(t1_ts, m3u.back()->end, url);
+                        block->tracks = m3u;
+                        items.emplace_back(block);
+                        continue;
+                    }
+                    auto maxEnd = util::EngineClock::time() + mConfig.calendarHorizon;
                     for (const auto& itm : m3u) {
                         if (itm->end <= maxEnd) {
                             items.emplace_back(itm);
@@ -38,6 +38,14 @@ struct Status {
     float rmsLinIn = 0.0f;
     float rmsLinOut = 0.0f;
     bool fallbackActive = false;
+    size_t reclaimPendingBytes = 0;
+    size_t reclaimedBytes = 0;
+    size_t lockedBytes = 0;
+    float cpuLoad = 0.0f;
+    nlohmann::json render;
+    nlohmann::json xruns;
+    nlohmann::json rtGuard;
+    nlohmann::json load;
     nlohmann::json players;
 };
 
@@ -45,6 +53,14 @@ void from_json(const nlohmann::json& j, Status& s) {
     j.at("rmsLinIn").get_to(s.rmsLinIn);
     j.at("rmsLinOut").get_to(s.rmsLinOut);
     j.at("fallbackActive").get_to(s.fallbackActive);
+    j.at("reclaimPendingBytes").get_to(s.reclaimPendingBytes);
+    j.at("reclaimedBytes").get_to(s.reclaimedBytes);
+    j.at("lockedBytes").get_to(s.lockedBytes);
+    j.at("cpuLoad").get_to(s.cpuLoad);
+    j.at("render").get_to(s.render);
+    j.at("xruns").get_to(s.xruns);
+    j.at("rtGuard").get_to(s.rtGuard);
+    j.at("load").get_to(s.load);
     j.at("players").get_to(s.players);
 }
 
@@ -53,6 +69,14 @@ void to_json(nlohmann::json& j, const Status& s) {
         {"rmsLinIn", s.rmsLinIn},
         {"rmsLinOut", s.rmsLinOut},
         {"fallbackActive", s.fallbackActive},
+        {"reclaimPendingBytes", s.reclaimPendingBytes},
+        {"reclaimedBytes", s.reclaimedBytes},
+        {"lockedBytes", s.lockedBytes},
+        {"cpuLoad", s.cpuLoad},
+        {"render", s.render},
+        {"xruns", s.xruns},
+        {"rtGuard", s.rtGuard},
+        {"load", s.load},
         {"players", s.players}
     };
 }
@@ -22,13 +22,16 @@
 
 #pragma once
 
+#include <atomic>
 #include <iostream>
 #include <iomanip>
 #include <string>
 #include <vector>
 #include <portaudio.h>
+#include <json.hpp>
 #include "audio.hpp"
 #include "../util/Log.hpp"
+#include "../util/RTGuard.hpp"
 
 namespace castor {
 namespace audio {
@@ -41,12 +44,24 @@ public:
         virtual ~Renderer() = default;
     };
     
+    // stream over- and underflows reported by PortAudio (status flags or blocking i/o results)
+    struct XRuns {
+        std::atomic<uint64_t> inputUnderflow = 0;
+        std::atomic<uint64_t> inputOverflow = 0;
+        std::atomic<uint64_t> outputUnderflow = 0;
+        std::atomic<uint64_t> outputOverflow = 0;
+
+        uint64_t total() const { return inputUnderflow + inputOverflow + outputUnderflow + outputOverflow; }
+    };
+
     const std::string mIDevName;
     const std::string mODevName;
     const double mSampleRate;
     const size_t mBufferSize;
     PaStream* mStream;
     Renderer* mRenderer;
+    XRuns mXRuns;
+    std::atomic<double> mOutputLatency = 0.0;
 
     Client(const std::string& tIDevName, const std::string& tODevName, double tSampleRate, size_t tBufferSize) :
         mIDevName(tIDevName),
@@ -105,7 +120,7 @@ public:
 
         PaStreamCallback* streamCallback = tRealtime ? &Client::paCallback : NULL;
 
-        auto res = Pa_OpenStream(&mStream, &iParams, &oParams, mSampleRate, mBufferSize, paNoFlag, streamCallback, mRenderer);
+        auto res = Pa_OpenStream(&mStream, &iParams, &oParams, mSampleRate, mBufferSize, paNoFlag, streamCallback, this);
         if (res != paNoError) {
             throw std::runtime_error("AudioClient Pa_OpenStream failed with error "+std::to_string(res)+" ("+Pa_GetErrorText(res)+")");
         }
@@ -150,8 +165,26 @@ public:
     }
 
     void render(sam_t* in, const sam_t* out, size_t nframes) {
-        Pa_ReadStream(mStream, in, nframes);
-        Pa_WriteStream(mStream, out, nframes);
+        if (Pa_ReadStream(mStream, in, nframes) == paInputOverflowed) count(mXRuns.inputOverflow);
+        if (Pa_WriteStream(mStream, out, nframes) == paOutputUnderflowed) count(mXRuns.outputUnderflow);
+    }
+
+    const XRuns& xruns() const {
+        return mXRuns;
+    }
+
+    // seconds from the start of the last callback until its output reaches the DAC
+    double outputLatency() const {
+        return mOutputLatency.load(std::memory_order_relaxed);
+    }
+
+    nlohmann::json getXRunsJSON() const {
+        return {
+            {"inputUnderflow", mXRuns.inputUnderflow.load()},
+            {"inputOverflow", mXRuns.inputOverflow.load()},
+            {"outputUnderflow", mXRuns.outputUnderflow.load()},
+            {"outputOverflow", mXRuns.outputOverflow.load()}
+        };
     }
 
     void printDeviceNames() {
@@ -166,17 +199,30 @@ public:
 
 private:
 
-    // int paCallbackMethod(const void* inputBuffer, void* outputBuffer, unsigned long framesPerBuffer, const PaStreamCallbackTimeInfo* timeInfo, PaStreamCallbackFlags statusFlags) {
-    //     if (mRenderer) mRenderer->renderCallback(static_cast<const sam_t*>(inputBuffer), static_cast<sam_t*>(outputBuffer), framesPerBuffer);
-    //     return paContinue;
-    // }
-
     // void paStreamFinishedMethod() {
     //     log.info() << "AudioClient stream finished";
     // }
 
+    static void count(std::atomic<uint64_t>& tCounter) {
+        tCounter.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void paCallbackMethod(const void* inputBuffer, void* outputBuffer, unsigned long framesPerBuffer, const PaStreamCallbackTimeInfo* timeInfo, PaStreamCallbackFlags statusFlags) {
+        util::RTGuard::Scope realtime;
+        if (statusFlags) {
+            if (statusFlags & paInputUnderflow) count(mXRuns.inputUnderflow);
+            if (statusFlags & paInputOverflow) count(mXRuns.inputOverflow);
+            if (statusFlags & paOutputUnderflow) count(mXRuns.outputUnderflow);
+            if (statusFlags & paOutputOverflow) count(mXRuns.outputOverflow);
+        }
+        if (timeInfo && timeInfo->outputBufferDacTime > 0) {
+            mOutputLatency.store(timeInfo->outputBufferDacTime - timeInfo->currentTime, std::memory_order_relaxed);
+        }
+        mRenderer->renderCallback(static_cast<const sam_t*>(inputBuffer), static_cast<sam_t*>(outputBuffer), framesPerBuffer);
+    }
+
     static int paCallback(const void* inputBuffer, void* outputBuffer, unsigned long framesPerBuffer, const PaStreamCallbackTimeInfo* timeInfo, PaStreamCallbackFlags statusFlags, void* userData) {
-        static_cast<Renderer*>(userData)->renderCallback(static_cast<const sam_t*>(inputBuffer), static_cast<sam_t*>(outputBuffer), framesPerBuffer);
+        static_cast<Client*>(userData)->paCallbackMethod(inputBuffer, outputBuffer, framesPerBuffer, timeInfo, statusFlags);
         return paContinue;
     }
 
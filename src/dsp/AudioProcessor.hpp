@@ -22,15 +22,22 @@
 
 #pragma once
 
+#include <algorithm>
 #include <chrono>
 #include <ctime>
 #include <iomanip>
 #include <memory>
+#include <span>
 #include <string>
 #include <thread>
 #include <functional>
 #include "audio.hpp"
+#include "Kernels.hpp"
+#include "PCMCache.hpp"
+#include "SharedPCM.hpp"
 #include "../util/Log.hpp"
+#include "../util/Reclaimer.hpp"
+#include "../util/TimerWheel.hpp"
 
 namespace castor {
 namespace audio {
@@ -50,7 +57,7 @@ public:
 
 class Input : public AudioProcessor {
 public:
-    const std::string name;
+    std::string name; // changes only while recycled
     std::string category;
     
     Input(const AudioStreamFormat& tClientFormat, const std::string tName = "") :
@@ -59,6 +66,15 @@ public:
     {}
     
     virtual ~Input() = default;
+
+    // accumulates nframes scaled by gain into out (used by the mix bus)
+    virtual size_t mix(const sam_t* in, sam_t* out, size_t nframes, float gain) = 0;
+
+    // overwrites out with nframes
+    size_t process(const sam_t* in, sam_t* out, size_t nframes) override {
+        memset(out, 0, nframes * clientFormat.channelCount * sizeof(sam_t));
+        return mix(in, out, nframes, 1.0f);
+    }
 };
 
 
@@ -68,10 +84,35 @@ public:
     virtual size_t readPosition() { return 0; }
     virtual size_t writePosition() { return 0; }
     virtual size_t capacity() { return 0; }
-    virtual float memorySizeMiB() { return 0; }
+    virtual size_t memorySize() { return 0; }
     virtual void resize(size_t tCapacity) {}
+
+    // keeps the samples from the read head to tAhead samples ahead locked in RAM, 0 unlocks (non-realtime threads)
+    virtual void lockWindow(size_t tAhead) {}
+
+    // returns the memory of samples read more than tMargin samples ago (non-realtime threads)
+    virtual void releasePlayed(size_t tMargin) {}
+
+    // reads samples not held in memory (mapped from disk) in up to tAhead samples ahead of the read head (non-realtime threads)
+    virtual void prefetch(size_t tAhead) {}
+
     virtual size_t write(const T* tData, size_t tLen) = 0;
+
+    // contiguous room for up to tLen samples at the write position, filled in place and published with commitWrite();
+    // empty if the buffer has to be written through write() in constant blocks
+    virtual std::span<T> writeSpan(size_t tLen) { return {}; }
+    virtual void commitWrite(size_t tLen) {}
+
     virtual size_t read(T* tData, size_t tLen) = 0;
+
+    // accumulates tLen interleaved samples into tData, scaled by one gain per frame of tChannels samples
+    virtual size_t mix(T* tData, size_t tLen, const float* tGain, size_t tChannels) = 0;
+
+    float memorySizeMiB() {
+        static constexpr float kibi = 1024.0f;
+        static constexpr float mibi = kibi * kibi;
+        return memorySize() / mibi;
+    }
 };
 
 
@@ -118,23 +159,28 @@ public:
 
 
 class Player : public Input, public BufferedSource, public Fader {
+    static inline std::atomic<uint64_t> sNextId = 1;
+
     time_t preloadTime;
     time_t loadRetryInterval = 3;
     time_t lastLoadAttempt = 0;
+    std::vector<float> mEnvelope;
 public:
 
     Player(const AudioStreamFormat& tClientFormat, const std::string& tName = "", time_t tPreloadTime = 0, float tFadeInTime = 0, float tFadeOutTime = 0) :
         Input(tClientFormat, tName),
         BufferedSource(),
         Fader(tFadeInTime, tFadeOutTime, clientFormat.sampleRate),
-        preloadTime(tPreloadTime)
+        preloadTime(tPreloadTime),
+        mEnvelope(std::max(clientFormat.frameSize, 1)),
+        id(sNextId++)
     {
         generateFadeCurves();
     }
 
     virtual ~Player() {
         log.debug() << "Player " << name << " dealloc...";
-        if (schedulingThread.joinable()) schedulingThread.join();
+        cancelTimers();
         log.debug() << "Player " << name << " dealloced";
     }
 
@@ -142,9 +188,18 @@ public:
         IDLE, WAIT, LOAD, CUED, PLAY, FAIL
     };
 
+    // transitions applied by the render thread at an exact sample
+    enum Transition : uint8_t {
+        START, FADE_OUT, MUTE
+    };
+
+    static constexpr auto kTransitionLeadTime = std::chrono::milliseconds(500); // transitions are posted to the render thread this early
+
+    uint64_t id; // unique over the process lifetime, unlike the address (renewed when recycled)
+
     std::atomic<State> state = IDLE;
 
-    State getState(const time_t& now = std::time(0)) const {
+    State getState(const time_t& now = util::EngineClock::time()) const {
         return state;
     }
 
@@ -178,33 +233,70 @@ public:
 
     virtual void play() {
         state = PLAY;
-        if (startCallback) startCallback(playItem);
+        announceStart();
     }
 
     virtual void stop() {
         if (state == IDLE) return;
+        mLoadCancelled = true; // a load in progress is obsolete
         state = IDLE;
-        isScheduling = false;
-        scheduleCV.notify_all();
+        cancelTimers();
     }
 
     virtual void load(const std::string& url, double position = 0) = 0;
 
     std::shared_ptr<PlayItem> playItem = nullptr;
-    std::thread schedulingThread;
+    util::Reclaimer* reclaimer = nullptr;
+    PCMCache* pcmCache = nullptr; // decoded files shared across loads and restarts (if any)
+    SharedPCM* sharedPCM = nullptr; // decoded files shared with the other players (if any)
+    bool crossFade = false; // fade out after end (overlapping the next item) instead of before
+    util::TimerWheel* scheduler = nullptr;
     std::atomic<bool> isLoaded = false;
+    std::atomic<double> decodedDuration = 0; // sec. of audio decoded by the last load (0 if taken from a cache)
     std::function<void(std::shared_ptr<PlayItem> item)> startCallback = nullptr;
-    std::mutex loadedMutex;
-    std::condition_variable loadedCV;
+    std::function<bool(Transition transition, std::chrono::system_clock::time_point time)> transitionCallback = nullptr; // posts to the render timeline
     std::mutex scheduleMutex;
-    std::condition_variable scheduleCV;
     bool isScheduling = false;
 
+    // drives start, fade-out and stop from the scheduler's timers
     virtual void schedule(std::shared_ptr<PlayItem> item) {
+        if (!scheduler) throw std::runtime_error("Player " + name + " has no scheduler");
         playItem = item;
         state = WAIT;
-        isScheduling = true;
-        schedulingThread = std::thread(&Player::waitForEvents, this);
+        {
+            std::lock_guard<std::mutex> lock(scheduleMutex);
+            isScheduling = true;
+        }
+        arm(START);
+    }
+
+    // prepares a player no longer referenced anywhere for another item, as if newly constructed
+    // (the factory sets up name, environment and callbacks again)
+    virtual void recycle() {
+        if (state != IDLE) stop();
+        cancelTimers();
+        id = sNextId++;
+        state = IDLE;
+        playItem = nullptr;
+        isLoaded = false;
+        lastLoadAttempt = 0;
+        decodedDuration = 0;
+        fadeInCurveIndex = -1;
+        fadeOutCurveIndex = -1;
+        mTransitionPosted = false;
+        startCallback = nullptr;
+        transitionCallback = nullptr;
+        reclaimer = nullptr;
+        scheduler = nullptr;
+        pcmCache = nullptr;
+        sharedPCM = nullptr;
+    }
+
+    // hands an owned object to the reclaimer (if any) instead of destroying it on the calling thread
+    template <typename T>
+    void retire(std::unique_ptr<T>& tObject) {
+        if (reclaimer) reclaimer->retire(std::move(tObject));
+        else tObject = nullptr;
     }
 
     void fadeIn() {
@@ -213,74 +305,160 @@ public:
     }
 
     void fadeOut() {
-        fadeOutCurveIndex = 0;
+        int notFading = -1;
+        fadeOutCurveIndex.compare_exchange_strong(notFading, 0);
     }
 
-    void waitForEvents() {
-        // auto loadTm = std::chrono::system_clock::from_time_t(playItem->start - preloadTime);
-        auto fadeInTm = std::chrono::system_clock::from_time_t(playItem->start);
-        auto fadeOutTm = std::chrono::system_clock::from_time_t(playItem->end) - std::chrono::milliseconds(static_cast<long>(fadeOutTime * 1000));
-        auto stopTm = std::chrono::system_clock::from_time_t(playItem->end);
-        
-        {
-            std::unique_lock<std::mutex> lock(scheduleMutex);
-
-            // wait until load time or stopped
-            // scheduleCV.wait_until(lock, loadTime, [this] { return !isScheduling; });
-            // if (!isScheduling) return;
-            // if (playItem->end + 5 < std::time(0)) return;
-
-            // log.debug(Log::Magenta) << "LOAD " << name;
-            // // loadSemaphore.acquire();
-            // while (!isLoaded && isScheduling) {
-            //     tryLoad();
-            //     if (!isLoaded) {
-            //         std::this_thread::sleep_for(std::chrono::seconds(3));
-            //     }
-            // }
-            // loadSemaphore.release();
-
-            // wait until loaded or stopped
-            scheduleCV.wait(lock, [this] { return isLoaded || !isScheduling; });
-            if (!isScheduling) return;
-
-            // wait until fade-in or stopped
-            scheduleCV.wait_until(lock, fadeInTm, [this] { return !isScheduling; });
-            if (!isScheduling) return;
-
-            log.info(Log::Magenta) << "PLAY " << name;
-            play();
-            // log.info(Log::Magenta) << "FADE IN " << name;
-            fadeIn();
+    // render thread
+
+    void apply(Transition tTransition) {
+        switch (tTransition) {
+            case START:
+                state = PLAY;
+                fadeIn();
+                break;
+            case FADE_OUT:
+                fadeOut();
+                break;
+            case MUTE:
+                fadeOutCurveIndex = -2;
+                break;
+        }
+    }
+
+    bool isFadeInPending() const {
+        return fadeInCurveIndex == 0;
+    }
+
+    // fading in done and not fading out
+    bool isSteady() const {
+        return fadeInCurveIndex == -2 && fadeOutCurveIndex == -1;
+    }
+
+    bool isFadedOut() const {
+        return fadeOutCurveIndex == -2;
+    }
+
+    std::chrono::system_clock::time_point fadeOutPoint() const {
+        auto fadeOutMs = std::chrono::milliseconds(static_cast<long>(fadeOutTime * 1000));
+        return std::chrono::system_clock::from_time_t(playItem->end) - (crossFade ? std::chrono::milliseconds(0) : fadeOutMs);
+    }
 
-            // wait until fade-out
-            scheduleCV.wait_until(lock, fadeOutTm, [this] { return !isScheduling; });
-            if (!isScheduling) return;
+    std::chrono::system_clock::time_point stopPoint() const {
+        auto fadeOutMs = std::chrono::milliseconds(static_cast<long>(fadeOutTime * 1000));
+        return std::chrono::system_clock::from_time_t(playItem->end) + (crossFade ? fadeOutMs : std::chrono::milliseconds(0));
+    }
+
+private:
+    util::TimerWheel::Id mLeadTimer = 0;
+    util::TimerWheel::Id mDueTimer = 0;
+    std::atomic<bool> mTransitionPosted = false;
+    bool mStartOnLoad = false;
+    std::atomic<bool> mLoadCancelled = false;
+
+    std::chrono::system_clock::time_point transitionPoint(Transition tTransition) const {
+        switch (tTransition) {
+            case START: return std::chrono::system_clock::from_time_t(playItem->start);
+            case FADE_OUT: return fadeOutPoint();
+            case MUTE: return stopPoint();
+        }
+        return {};
+    }
 
-            // log.info(Log::Magenta) << "FADE OUT " << name;
-            fadeOut();
+    // arms the timers of the next transition: it is posted ahead to the render timeline (if any) and applied
+    // here at its due time if posting wasn't possible
+    void arm(Transition tTransition) {
+        auto due = transitionPoint(tTransition);
+        std::lock_guard<std::mutex> lock(scheduleMutex);
+        if (!isScheduling) return;
+        mTransitionPosted = false;
+        mLeadTimer = transitionCallback ? scheduler->schedule(due - kTransitionLeadTime, [this, tTransition, due] { onLead(tTransition, due); }) : 0;
+        mDueTimer = scheduler->schedule(due, [this, tTransition] { onDue(tTransition); });
+    }
 
-            // wait until stop time
-            scheduleCV.wait_until(lock, stopTm, [this] { return !isScheduling; });
-            if (!isScheduling) return;
+    void onLead(Transition tTransition, std::chrono::system_clock::time_point tDue) {
+        if (tTransition == START && !isLoaded) return;
+        mTransitionPosted = transitionCallback(tTransition, tDue);
+    }
 
-            log.info(Log::Magenta) << "STOP " << name;
-            stop();
+    void onDue(Transition tTransition) {
+        switch (tTransition) {
+            case START:
+                {
+                    std::lock_guard<std::mutex> lock(scheduleMutex);
+                    if (!isScheduling) return;
+                    if (!isLoaded) {
+                        mStartOnLoad = true; // started by the load thread
+                        return;
+                    }
+                }
+                start();
+                break;
+            case FADE_OUT:
+                if (!mTransitionPosted) fadeOut();
+                arm(MUTE);
+                break;
+            case MUTE:
+                log.info(Log::Magenta) << "STOP " << name;
+                stop();
+                break;
         }
     }
 
-    
-    
+    void start() {
+        log.info(Log::Magenta) << "PLAY " << name;
+        if (mTransitionPosted) {
+            announceStart();
+        } else {
+            play();
+            fadeIn();
+        }
+        arm(FADE_OUT);
+    }
 
+    void cancelTimers() {
+        util::TimerWheel::Id lead, due;
+        {
+            std::lock_guard<std::mutex> lock(scheduleMutex);
+            isScheduling = false;
+            mStartOnLoad = false;
+            lead = std::exchange(mLeadTimer, 0);
+            due = std::exchange(mDueTimer, 0);
+        }
+        if (scheduler) {
+            scheduler->cancel(lead);
+            scheduler->cancel(due);
+        }
+    }
+
+    // returns to the state before the load, unless stopped meanwhile
+    bool abandonLoad(State tPrevState) {
+        auto loading = LOAD;
+        state.compare_exchange_strong(loading, tPrevState);
+        log.debug() << "Player " << name << " load cancelled";
+        return false;
+    }
+
+public:
     bool isInLoadTime() {
-        auto now = std::time(0);
+        auto now = util::EngineClock::time();
         auto min = playItem->start - preloadTime;
         auto max = playItem->end - 5;
         return now >= min && now <= max;
     }
 
+    // not loaded yet although due by tHorizon (failed loads don't count until their retry)
+    bool isLoadPending(time_t tHorizon) {
+        return !isLoaded && state != FAIL && playItem && playItem->start <= tHorizon && isInLoadTime();
+    }
+
+    // sec. of audio the load of the current item decodes up front (0 = unknown, loaded within the preload time)
+    virtual double loadWork() const {
+        return 0;
+    }
+
     bool needsLoad() {
-        return !isLoaded && isInLoadTime() && (std::time(0) > lastLoadAttempt+loadRetryInterval);
+        return !isLoaded && isInLoadTime() && (util::EngineClock::time() > lastLoadAttempt+loadRetryInterval);
     }
 
     // bool isInPlayTime() const {
@@ -294,7 +472,7 @@ public:
     }
 
     bool isFinished() const {
-        return std::time(0) > (playItem->end) && (state == IDLE || state == FAIL);
+        return util::EngineClock::time() > (playItem->end) && (state == IDLE || state == FAIL);
     }
 
 
@@ -317,6 +495,23 @@ public:
         return mBuffer->memorySizeMiB();
     }
 
+    size_t memorySize() {
+        if (!mBuffer) return 0;
+        return mBuffer->memorySize();
+    }
+
+    void lockBuffer(size_t tAhead) {
+        if (mBuffer) mBuffer->lockWindow(tAhead);
+    }
+
+    void releasePlayed(size_t tMargin) {
+        if (mBuffer) mBuffer->releasePlayed(tMargin);
+    }
+
+    void prefetchBuffer(size_t tAhead) {
+        if (mBuffer) mBuffer->prefetch(tAhead);
+    }
+
     
     static void getStatusHeader(std::ostringstream& strstr) {
         using namespace std;
@@ -373,62 +568,135 @@ public:
         return j;
     }
 
-    void tryLoad() {
-        state = LOAD;
-        time_t pos = std::max(0l, std::time(0) - static_cast<time_t>(playItem->start));
+    // reports the start of the item to the engine (playlists report each track as it comes up)
+    virtual void announceStart() {
+        if (startCallback) startCallback(playItem);
+    }
+
+    // aborts a load in progress, the item stays due and can be loaded again
+    virtual void cancelLoad() {
+        mLoadCancelled = true;
+    }
+
+    // clears an earlier cancel as the player is queued for loading again (a cancel after this one still counts)
+    void resetLoadCancel() {
+        mLoadCancelled = false;
+    }
+
+    // returns true once loaded (false if the load failed or was cancelled)
+    bool tryLoad() {
+        auto prevState = state.load();
+        if (prevState == IDLE || !state.compare_exchange_strong(prevState, LOAD)) return false; // stopped meanwhile
+        time_t pos = std::max(0l, util::EngineClock::time() - static_cast<time_t>(playItem->start));
         try {
             load(playItem->uri, pos);
-            state = CUED;
-            isLoaded = true;
-            scheduleCV.notify_one();
+            bool startNow;
+            {
+                // checked again with the cue, so that a stop (which ends scheduling under this mutex) is never overwritten
+                std::lock_guard<std::mutex> lock(scheduleMutex);
+                if (!isScheduling || mLoadCancelled) return abandonLoad(prevState);
+                state = CUED;
+                isLoaded = true;
+                startNow = std::exchange(mStartOnLoad, false); // loaded after start time
+            }
+            if (startNow) start();
+            return true;
         }
         catch (const std::exception& e) {
+            if (mLoadCancelled) return abandonLoad(prevState);
             state = FAIL;
-            lastLoadAttempt = std::time(0);
+            lastLoadAttempt = util::EngineClock::time();
             log.error() << "AudioProcessor failed to load '" << playItem->uri << "': " << e.what();
+            return false;
         }
     }
     
 
-    // temporary fade workaround
-
-    virtual size_t process(const sam_t* in, sam_t* out, size_t nframes) override {
+    // gain envelope and fading
 
+    size_t mix(const sam_t* in, sam_t* out, size_t nframes, float gain) override {
         if (fadeInCurveIndex == -1 || fadeOutCurveIndex == -2) return 0; // don't process if not started fade in yet or fade out done
 
-        auto sampleCount = nframes * 2;
-        auto samplesRead = mBuffer->read(out, sampleCount);
-        auto framesRead = samplesRead / 2;
+        const size_t nch = clientFormat.channelCount;
+        size_t framesMixed = 0;
+        while (framesMixed < nframes) {
+            auto len = std::min(nframes - framesMixed, mEnvelope.size());
+            renderEnvelope(len, gain);
+            auto mixed = mBuffer->mix(out + framesMixed * nch, len * nch, mEnvelope.data(), nch) / nch;
+            framesMixed += mixed;
+            if (mixed < len) break;
+        }
+        return framesMixed;
+    }
 
-        if (fadeInCurveIndex >= 0) {
-            // log.debug() << "fade in";
-            for (auto i = 0; i < framesRead && fadeInCurveIndex < fadeInCurve.size(); ++i) {
-                out[i*2+0] *= fadeInCurve[fadeInCurveIndex]; 
-                out[i*2+1] *= fadeInCurve[fadeInCurveIndex++]; 
-            }
+    // mixes samples already rendered from this player's buffer (render-ahead) through its gain envelope
+    size_t mixFrom(const sam_t* src, sam_t* out, size_t nframes, float gain) {
+        if (fadeInCurveIndex == -1 || fadeOutCurveIndex == -2) return 0;
 
-            if (fadeInCurveIndex >= fadeInCurve.size()) fadeInCurveIndex = -2;
+        const size_t nch = clientFormat.channelCount;
+        for (size_t done = 0; done < nframes;) {
+            auto len = std::min(nframes - done, mEnvelope.size());
+            renderEnvelope(len, gain);
+            kernels::mixRamp(out + done * nch, src + done * nch, len * nch, mEnvelope.data(), nch);
+            done += len;
         }
+        return nframes;
+    }
 
-        else if (fadeOutCurveIndex >= 0) {
-            // log.debug() << "fade out";
-            size_t i;
-            for (i = 0; i < framesRead && fadeOutCurveIndex < fadeOutCurve.size(); ++i) {
-                out[i*2+0] *= fadeOutCurve[fadeOutCurveIndex]; 
-                out[i*2+1] *= fadeOutCurve[fadeOutCurveIndex++]; 
-            }
+    // sources with content decoded ahead of the read head may be rendered ahead of time by a non-realtime thread
+    virtual bool canRenderAhead() const {
+        return false;
+    }
 
-            if (fadeOutCurveIndex >= fadeOutCurve.size()) {
-                while (i < framesRead) {
-                    out[i*2+0] = 0;
-                    out[i*2+1] = 0;
-                    ++i;
-                }
-                fadeOutCurveIndex = -2;
+    // playback is about to run out of decoded content
+    virtual bool isStarved() const {
+        return false;
+    }
+
+    // renders nframes without fades at a constant gain (render-ahead thread, while the render thread doesn't mix this player)
+    size_t renderAhead(sam_t* out, size_t nframes, float gain) {
+        const size_t nch = clientFormat.channelCount;
+        auto frames = mBuffer->read(out, nframes * nch) / nch;
+        kernels::mulGain(out, out, frames * nch, gain);
+        return frames;
+    }
+
+private:
+    // fills the per-frame gain envelope and advances the fade curves
+    void renderEnvelope(size_t nframes, float gain) {
+        int inStart = fadeInCurveIndex;
+        int outStart = fadeOutCurveIndex;
+        int inIdx = inStart;
+        int outIdx = outStart;
+        const int inLen = fadeInCurve.size();
+        const int outLen = fadeOutCurve.size();
+        auto env = mEnvelope.data();
+
+        std::fill_n(env, nframes, gain);
+
+        if (inIdx >= 0) {
+            size_t len = std::min<size_t>(nframes, std::max(inLen - inIdx, 0));
+            kernels::mulGain(env, fadeInCurve.data() + inIdx, len, gain);
+            inIdx += len;
+            if (inIdx >= inLen) inIdx = -2;
+        }
+
+        if (outIdx >= 0) {
+            size_t len = std::min<size_t>(nframes, std::max(outLen - outIdx, 0));
+            kernels::mulRamp(env, env, len, fadeOutCurve.data() + outIdx, 1);
+            outIdx += len;
+            if (outIdx >= outLen) {
+                std::fill(env + len, env + nframes, 0.0f);
+                outIdx = -2;
             }
         }
+        else if (outIdx == -2) {
+            std::fill_n(env, nframes, 0.0f);
+        }
 
-        return framesRead;
+        // don't overwrite a fade triggered concurrently by the scheduling thread
+        fadeInCurveIndex.compare_exchange_strong(inStart, inIdx);
+        fadeOutCurveIndex.compare_exchange_strong(outStart, outIdx);
     }
 };
 }
@@ -32,7 +32,6 @@ extern "C" {
 #include <libavcodec/avcodec.h>
 #include <libavutil/avutil.h>
 #include <libavutil/opt.h>
-#include <libavutil/audio_fifo.h>
 #include <libswresample/swresample.h>
 }
 #include "audio.hpp"
@@ -74,6 +73,10 @@ public:
         log.debug() << "CodecBase cancelled";
     }
 
+    bool isCancelled() const {
+        return mCancelled;
+    }
+
     static std::string AVErrorString(int error) {
         char errbuf[256];
         av_strerror(error, errbuf, 256);
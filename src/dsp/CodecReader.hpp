@@ -22,6 +22,9 @@
 
 #pragma once
 
+#include <algorithm>
+#include <cmath>
+#include <vector>
 #include "CodecBase.hpp"
 #include "AudioProcessor.hpp"
 
@@ -40,11 +43,17 @@ class CodecReader : public CodecBase {
     SwrContext* mSwrCtx = nullptr;
     AVPacket* mPacket = nullptr;
     AVFrame* mFrame = nullptr;
-    AVAudioFifo* mFIFO = nullptr;
     int mStreamIndex = -1;
+    AVRational mTimeBase = {1, 1};
+    int64_t mStartTime = 0; // of the stream, in its time base
+    int64_t mInputPos = 0; // next decoded sample (per channel) from the start of the stream
+    int64_t mSkipUntil = 0; // decoded samples before are dropped
+    size_t mPending = 0; // converted samples in the frame buffer not yet written
     
 public:
-    CodecReader(const AudioStreamFormat& tClientFormat, const std::string& tURL, double tSeek = 0) :
+    // tThreads decoder threads for codecs that support them (0 = one per core), only worth it for readers decoding
+    // a whole file at once, as the threads stay around as long as the reader
+    CodecReader(const AudioStreamFormat& tClientFormat, const std::string& tURL, double tSeek = 0, int tThreads = 1) :
         CodecBase(tClientFormat, kFrameBufferSize, tURL),
         mSampleCount(0)
     {
@@ -95,6 +104,11 @@ public:
             throw std::runtime_error("Could not fill codec context.");
         }
 
+        mCodecCtx->thread_count = tThreads;
+        mCodecCtx->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+        mTimeBase = audioStream->time_base;
+        if (audioStream->start_time != AV_NOPTS_VALUE) mStartTime = audioStream->start_time;
+
         // log.debug() << "CodecReader open codec...";
         if (avcodec_open2(mCodecCtx, codec, nullptr) < 0) {
             throw std::runtime_error("Could not open codec.");
@@ -139,12 +153,9 @@ public:
         }
 
         log.debug() << "CodecReader inited " << mURL << " (" << mSampleCount << " samples)";
-
-        mFIFO = av_audio_fifo_alloc(AV_SAMPLE_FMT_FLT, 1, kFrameBufferSize);
     }
 
     ~CodecReader() {
-        av_audio_fifo_free(mFIFO);
         av_packet_free(&mPacket);
         av_frame_free(&mFrame);
         swr_free(&mSwrCtx);
@@ -161,65 +172,121 @@ public:
         return std::make_unique<Metadata>(mFormatCtx->metadata);
     }
 
+    bool isSeekable() const {
+        return !mURL.starts_with("http");
+    }
+
+    // drops decoded input before tTime seconds from the start of the stream (to the sample, by frame timestamps),
+    // so a reader seeked ahead of a segment starts feeding the resampler at a known sample
+    void skipUntil(double tTime) {
+        mSkipUntil = std::llround(tTime * mCodecCtx->sample_rate);
+    }
 
-    void read(SourceBuffer<sam_t>& tBuffer) {
-        log.debug() << "CodecReader read " << mURL;
 
-        // satisfy source buffer with constant block size
-        auto outFrameSize = mClientFormat.frameSize * mClientFormat.channelCount;
+    // returns true if the input was decoded to its end (not cancelled, no read or decode error)
+    bool read(SourceBuffer<sam_t>& tBuffer) {
+        log.debug() << "CodecReader read " << mURL;
 
-        while (!mCancelled && av_read_frame(mFormatCtx, mPacket) >= 0) {
-            if (mPacket->stream_index != mStreamIndex) continue;
+        mPending = 0;
+        auto complete = true;
+        int res = 0;
+        while (!mCancelled && complete && (res = av_read_frame(mFormatCtx, mPacket)) >= 0) {
+            if (mPacket->stream_index != mStreamIndex) {
+                av_packet_unref(mPacket);
+                continue;
+            }
             if (avcodec_send_packet(mCodecCtx, mPacket) < 0) break;
 
             while (!mCancelled && avcodec_receive_frame(mCodecCtx, mFrame) >= 0) {
-                auto maxSamples = swr_get_out_samples(mSwrCtx, mFrame->nb_samples);
-                auto maxBufSize = maxSamples * mClientFormat.channelCount;
-                // if (mFrameBuffer.size() < maxBufSize) mFrameBuffer.resize(maxBufSize); // should not happen with sufficient buffer size
-
-                // reading maxSamples avoids internal buffering but doesn't guarantee full block size
-                uint8_t* outData[1] = { (uint8_t*) mFrameBuffer.data() };
-                int convSamples = swr_convert(mSwrCtx, outData, maxSamples, (const uint8_t**) mFrame->data, mFrame->nb_samples);
-                // log.debug() << "max samples: " << maxSamples << " converted samples: " << convSamples;
-
-                if (convSamples < 0) {
-                    av_packet_unref(mPacket);
-                    av_frame_unref(mFrame);
-                    log.error() << "CodecReader resample error";
-                    break;
-                }
-
-                // use fifo to create desired chunks (and reuse frame buffer to save resources)
-                auto fifoWritten = av_audio_fifo_write(mFIFO, (void**) outData, convSamples * mClientFormat.channelCount);
-                auto fifosz = av_audio_fifo_size(mFIFO);
-                // log.debug() << fifoWritten << " written to fifo, size " << fifisz;
-
-                while (!mCancelled && fifosz >= outFrameSize) {
-                    void* dat[1] = { reinterpret_cast<uint8_t*>(mFrameBuffer.data()) };
-
-                    auto fifoRead = av_audio_fifo_read(mFIFO, dat, outFrameSize);
-                    // log.debug() << read << " read from fifo";
-
-                    if (fifoRead != outFrameSize) {
-                        log.warn() << "CodecReader failed to read complete block from fifo";
-                        break;
-                    }
-
-                    auto written = tBuffer.write(mFrameBuffer.data(), outFrameSize);
-                    if (written != outFrameSize) {
-                        log.debug() << "CodecReader could not write all samples to output buffer";
-                        break;
-                    }
-
-                    fifosz = av_audio_fifo_size(mFIFO);
-                }
+                complete = convertFrame(tBuffer);
+                av_frame_unref(mFrame);
+                if (!complete) break;
             }
 
             av_packet_unref(mPacket);
-            av_frame_unref(mFrame);
+        }
+
+        // samples delayed by the resampler and the last partial block
+        if (!mCancelled && complete && res == AVERROR_EOF) {
+            complete = convert(tBuffer, nullptr, 0) && writePending(tBuffer);
         }
 
         log.debug() << "CodecReader read finished " << mURL;
+        return !mCancelled && complete && res == AVERROR_EOF;
+    }
+
+private:
+    // resamples the decoded frame from the skip position on
+    bool convertFrame(SourceBuffer<sam_t>& tBuffer) {
+        auto count = mFrame->nb_samples;
+        if (mFrame->best_effort_timestamp != AV_NOPTS_VALUE) {
+            mInputPos = std::llround((mFrame->best_effort_timestamp - mStartTime) * av_q2d(mTimeBase) * mCodecCtx->sample_rate);
+        }
+        auto skip = static_cast<int>(std::clamp<int64_t>(mSkipUntil - mInputPos, 0, count));
+        mInputPos += count;
+        if (skip == count) return true;
+        if (skip == 0) return convert(tBuffer, (const uint8_t**) mFrame->extended_data, count);
+
+        auto format = static_cast<AVSampleFormat>(mFrame->format);
+        auto planar = av_sample_fmt_is_planar(format);
+        auto channels = mCodecCtx->ch_layout.nb_channels;
+        auto offset = skip * av_get_bytes_per_sample(format) * (planar ? 1 : channels);
+        std::vector<const uint8_t*> planes(planar ? channels : 1);
+        for (size_t i = 0; i < planes.size(); ++i) planes[i] = mFrame->extended_data[i] + offset;
+        return convert(tBuffer, planes.data(), count - skip);
+    }
+
+    // resamples tCount input frames (nullptr flushes the resampler), directly into the buffer if it offers room,
+    // otherwise through the frame buffer in blocks of the client frame size
+    bool convert(SourceBuffer<sam_t>& tBuffer, const uint8_t** tInput, int tCount) {
+        auto channels = mClientFormat.channelCount;
+        auto maxFrames = swr_get_out_samples(mSwrCtx, tCount);
+        if (maxFrames <= 0) return true;
+        auto maxSamples = static_cast<size_t>(maxFrames) * channels;
+
+        auto span = tBuffer.writeSpan(maxSamples);
+        if (mPending == 0 && span.size() == maxSamples) {
+            uint8_t* out[1] = { reinterpret_cast<uint8_t*>(span.data()) };
+            auto frames = swr_convert(mSwrCtx, out, maxFrames, tInput, tCount);
+            if (frames < 0) {
+                log.error() << "CodecReader resample error";
+                return false;
+            }
+            tBuffer.commitWrite(frames * channels);
+            return true;
+        }
+
+        if (mFrameBuffer.size() < mPending + maxSamples) mFrameBuffer.resize(mPending + maxSamples);
+        uint8_t* out[1] = { reinterpret_cast<uint8_t*>(mFrameBuffer.data() + mPending) };
+        auto frames = swr_convert(mSwrCtx, out, maxFrames, tInput, tCount);
+        if (frames < 0) {
+            log.error() << "CodecReader resample error";
+            return false;
+        }
+        mPending += frames * channels;
+
+        // buffers offering room take any length (here across the end of their current span)
+        if (!span.empty()) return writePending(tBuffer);
+
+        auto blockSize = mClientFormat.frameSize * channels;
+        size_t offset = 0;
+        while (!mCancelled && mPending - offset >= blockSize) {
+            if (tBuffer.write(mFrameBuffer.data() + offset, blockSize) != blockSize) {
+                log.debug() << "CodecReader could not write all samples to output buffer";
+                return false;
+            }
+            offset += blockSize;
+        }
+        mPending -= offset;
+        if (offset && mPending) memmove(mFrameBuffer.data(), mFrameBuffer.data() + offset, mPending * sizeof(sam_t));
+        return true;
+    }
+
+    bool writePending(SourceBuffer<sam_t>& tBuffer) {
+        if (mPending == 0) return true;
+        auto written = tBuffer.write(mFrameBuffer.data(), mPending);
+        mPending = 0;
+        return written > 0;
     }
 };
 }
@@ -59,7 +59,6 @@ class Fallback : public Input {
     std::atomic<int> mActivePlayerIdxB = -1;
     std::mutex mPlayersMutex;
     std::deque<std::shared_ptr<FilePlayer>> mPlayers{};
-    std::vector<sam_t> mMixBuffer;
 
 public:
     Fallback(const AudioStreamFormat& tClientFormat, const std::string& tFallbackURL, size_t tBufferTime, float tCrossFadeTime, bool tShuffle, bool tSineSynth) :
@@ -71,8 +70,7 @@ public:
         mSineSynth(tSineSynth),
         mFadeOutSampleOffset(clientFormat.sampleRate * clientFormat.channelCount * mCrossFadeTime),
         mOscL(clientFormat.sampleRate),
-        mOscR(clientFormat.sampleRate),
-        mMixBuffer(clientFormat.frameSize * clientFormat.channelCount)
+        mOscR(clientFormat.sampleRate)
     {
         mOscL.setFrequency(kBaseFreq);
         mOscR.setFrequency(kBaseFreq * (5.0 / 4.0));
@@ -112,7 +110,7 @@ public:
     void runControl() {
         while (mRunning) {
             control();
-            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            util::EngineClock::sleepFor(std::chrono::milliseconds(100));
         }
     }
 
@@ -124,12 +122,12 @@ public:
                 mPlayers.clear();
             }
 
-            if (mPlayers.empty() && (mLastLoad == 0 || mLastLoad + kLoadRetryInterval <= std::time(0))) {
+            if (mPlayers.empty() && (mLastLoad == 0 || mLastLoad + kLoadRetryInterval <= util::EngineClock::time())) {
                 loadQueue();
-                mLastLoad = std::time(0);
+                mLastLoad = util::EngineClock::time();
             }
 
-            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            util::EngineClock::sleepFor(std::chrono::milliseconds(100));
         }
     }
 
@@ -252,25 +250,22 @@ public:
     }
 
 
-    void process(const sam_t* in, sam_t* out, size_t nframes) {
+    size_t mix(const sam_t* in, sam_t* out, size_t nframes, float gain) override {
         auto playerIdxA = mActivePlayerIdxA.load();
         auto playerIdxB = mActivePlayerIdxB.load();
         if (playerIdxA >= 0) {
-            mPlayers[playerIdxA]->process(in, out, nframes);
+            mPlayers[playerIdxA]->mix(in, out, nframes, gain);
             if (playerIdxB >= 0) {
-                mPlayers[playerIdxB]->process(in, mMixBuffer.data(), nframes);
-                for (auto i = 0; i < nframes; ++i) {
-                    out[i*2+0] += mMixBuffer[i*2+0];
-                    out[i*2+1] += mMixBuffer[i*2+1];
-                }
+                mPlayers[playerIdxB]->mix(in, out, nframes, gain);
             }
         }
         else if (mSineSynth) {
             for (auto i = 0; i < nframes; ++i) {
-                out[i*2]   += mOscL.process() * kGain;
-                out[i*2+1] += mOscR.process() * kGain;
+                out[i*2]   += mOscL.process() * kGain * gain;
+                out[i*2+1] += mOscR.process() * kGain * gain;
             }
         }
+        return nframes;
     }
 };
 }
@@ -61,7 +61,7 @@ namespace audio {
 public:
     std::function<void(std::shared_ptr<PlayItem> item)> startCallback = nullptr;
 
-    FallbackPremix(const AudioStreamFormat& tClientFormat, const std::string& tFallbackURL, size_t tBufferTime, float tCrossFadeTime, bool tShuffle, bool tSineSynth) :
+    FallbackPremix(const AudioStreamFormat& tClientFormat, const std::string& tFallbackURL, size_t tBufferTime, float tCrossFadeTime, bool tShuffle, bool tSineSynth, bool tCompact = false, std::shared_ptr<util::ChunkPool> tPool = util::ChunkPool::shared()) :
         Input(tClientFormat),
         mFallbackURL(tFallbackURL),
         mBufferTime(tBufferTime),
@@ -71,7 +71,7 @@ public:
         mFadeOutSampleOffset(clientFormat.sampleRate * clientFormat.channelCount * mCrossFadeTime),
         mOscL(clientFormat.sampleRate),
         mOscR(clientFormat.sampleRate),
-        mPremixPlayer(tClientFormat, "fallback", tBufferTime, 1, 0.5, mCrossFadeTime),
+        mPremixPlayer(tClientFormat, "fallback", tBufferTime, 1, 0.5, mCrossFadeTime, tCompact, std::move(tPool)),
         mProgram(std::make_shared<api::Program>())
     {
         mOscL.setFrequency(kBaseFreq);
@@ -95,6 +95,21 @@ public:
         return mActive;
     }
 
+    // keeps the premix around the read head locked in RAM (0 unlocks)
+    void lockBuffer(size_t tAhead) {
+        mPremixPlayer.lockBuffer(tAhead);
+    }
+
+    // returns the memory of premixed samples played more than tMargin samples ago
+    void releasePlayed(size_t tMargin) {
+        mPremixPlayer.releasePlayed(tMargin);
+    }
+
+    // set before run()
+    void setCache(PCMCache* tCache) {
+        mPremixPlayer.pcmCache = tCache;
+    }
+
     void run() {
         if (mFallbackURL.empty()) {
             log.error() << "Fallback folder not set";
@@ -120,11 +135,11 @@ public:
 
     void runLoad() {
         while (mRunning) {
-            if (mPremixPlayer.numTracks() == 0 && (mLastLoad == 0 || mLastLoad + kLoadRetryInterval <= std::time(0))) {
+            if (mPremixPlayer.numTracks() == 0 && (mLastLoad == 0 || mLastLoad + kLoadRetryInterval <= util::EngineClock::time())) {
                 load();
-                mLastLoad = std::time(0);
+                mLastLoad = util::EngineClock::time();
             }
-            std::this_thread::sleep_for(std::chrono::milliseconds(500));
+            util::EngineClock::sleepFor(std::chrono::milliseconds(500));
         }
     }
 
@@ -213,15 +228,16 @@ public:
     }
 
 
-    size_t process(const sam_t* in, sam_t* out, size_t nframes) override {
-        auto processed = mPremixPlayer.process(in, out, nframes);
+    size_t mix(const sam_t* in, sam_t* out, size_t nframes, float gain) override {
+        auto processed = mPremixPlayer.mix(in, out, nframes, gain);
         if (processed == 0 && mActive && mSineSynth) {
             for (auto i = 0; i < nframes; ++i) {
-                out[i*2]   += mOscL.process() * kGain;
-                out[i*2+1] += mOscR.process() * kGain;
+                out[i*2]   += mOscL.process() * kGain * gain;
+                out[i*2+1] += mOscR.process() * kGain * gain;
             }
+            return nframes;
         }
-        return nframes;
+        return processed;
     }
 };
 
@@ -22,71 +22,648 @@
 
 #pragma once
 
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <thread>
+#include <vector>
 #include "AudioProcessor.hpp"
 #include "CodecReader.hpp"
+#include "PCMCache.hpp"
+#include "../util/ChunkPool.hpp"
 #include "../util/Log.hpp"
+#include "../util/MemoryPages.hpp"
+#include "../util/SPSCRing.hpp"
 #include "../util/util.hpp"
 
 namespace castor {
 namespace audio {
 
+// Whole file (or premix) in memory, stored in fixed-size chunks from a pool that are added while decoding,
+// so the buffer grows to the actual decoded length (the container duration is only a hint) without
+// reallocating or copying. Samples are kept as T or, with compact storage, as 16-bit integers converted
+// back on read (half the memory); cache entries are mapped as they are.
+// Chunk boundaries are frame aligned for power-of-two channel counts.
+// A window of chunks around the read head can be locked in RAM and chunks played long enough ago can be
+// released (both by a non-realtime thread); writing to released chunks after a rewind acquires them again.
+// A finished buffer can be shared read-only by other buffers, each with its own read position; its played
+// chunks are released only while a single reader is left, after which it can't be shared anymore.
 template <typename T>
 class FileBuffer : public SourceBuffer<T> {
+    static constexpr size_t kScratchSize = 4096;
+
+    std::shared_ptr<util::ChunkPool> mPool;
+    const size_t mChunkShift; // log2 of samples per chunk
+    const size_t mChunkMask;
+    std::vector<std::unique_ptr<void*[]>> mTables; // chunk tables, the last one is current (older ones stay valid for readers)
+    std::atomic<void**> mTable = nullptr;
+    size_t mTableSize = 0;
+    size_t mChunkCount = 0;
+    std::vector<T> mScratch;
+    std::mutex mMutex; // chunk table and lock window changes from threads other than the writer
+    std::vector<bool> mLocked; // per chunk (or chunk-sized span of a mapped entry) held locked by this reader
+    size_t mLockBegin = 0; // chunks [mLockBegin, mLockEnd) may be locked
+    size_t mLockEnd = 0;
+    size_t mPlayedEnd = 0; // chunks below were released after playing
+    std::atomic<size_t> mReleased = 0; // chunks taken out of the table below mChunkCount
+    std::mutex mStorageMutex; // readers, locks and truncation of this buffer as the storage of others
+    std::vector<const FileBuffer*> mReaders; // buffers sharing this one, the first accounts for its memory
+    std::vector<uint32_t> mLockCounts; // per chunk, by this buffer and its readers
+    bool mTruncated = false; // played chunks released by its last reader
+    size_t mPrefetchEnd = 0; // mapped samples read in below
+
 protected:
     std::atomic<size_t> mReadPos = 0;
     std::atomic<size_t> mWritePos = 0;
-    size_t mCapacity = 0;
-    std::vector<T> mBuffer;
+    std::atomic<size_t> mCapacity = 0;
+    const bool mCompact;
+    std::shared_ptr<const PCMCache::Entry> mEntry = nullptr; // mapped instead of chunks
+    const T* mData = nullptr; // mapped samples
+    std::shared_ptr<FileBuffer> mShared = nullptr; // read instead of chunks
 
 public:
+    FileBuffer(bool tCompact = false, std::shared_ptr<util::ChunkPool> tPool = util::ChunkPool::shared()) :
+        mPool(std::move(tPool)),
+        mChunkShift(std::countr_zero(util::ChunkPool::kChunkSize / (tCompact ? sizeof(int16_t) : sizeof(T)))),
+        mChunkMask((size_t(1) << mChunkShift) - 1),
+        mCompact(tCompact)
+    {}
+
+    ~FileBuffer() {
+        std::lock_guard<std::mutex> lock(mMutex);
+        moveLockWindow(0, 0);
+        unshare();
+        releaseChunks(0);
+    }
+
+    FileBuffer(const FileBuffer&) = delete;
+    FileBuffer& operator=(const FileBuffer&) = delete;
+
     size_t readPosition() override { return mReadPos; }
     size_t writePosition() override { return mWritePos; }
     size_t capacity() override { return mCapacity; }
 
-    float memorySizeMiB() override {
-        static constexpr float kibi = 1024.0f;
-        static constexpr float mibi = kibi * kibi;
-        float bytesz = mCapacity * sizeof(T);
-        return bytesz / mibi;
+    size_t memorySize() override {
+        if (!mShared) return ownedBytes();
+        std::lock_guard<std::mutex> storageLock(mShared->mStorageMutex);
+        return mShared->mReaders.front() == this ? mShared->ownedBytes() : 0; // counted once
+    }
+
+    std::shared_ptr<util::ChunkPool> pool() const {
+        return mPool;
+    }
+
+    bool isCompact() const {
+        return mCompact;
     }
 
+    // converts tLen samples from tPos on into tData, independent of the read position
+    void copy(size_t tPos, T* tData, size_t tLen) const {
+        if (mData) {
+            memcpy(tData, &mData[tPos], tLen * sizeof(T));
+        } else if (mCompact) {
+            forEachSpan<int16_t>(tPos, tLen, [&](int16_t* src, size_t offset, size_t len) { kernels::fromInt16(tData + offset, src, len); });
+        } else {
+            forEachSpan<T>(tPos, tLen, [&](T* src, size_t offset, size_t len) { memcpy(tData + offset, src, len * sizeof(T)); });
+        }
+    }
+
+    // tCapacity is the expected length, chunks are added as samples are written
     void resize(size_t tCapacity) override {
+        std::lock_guard<std::mutex> lock(mMutex);
+        moveLockWindow(0, 0);
+        mPlayedEnd = 0;
+        unshare();
+        mEntry = nullptr;
+        mData = nullptr;
         mReadPos = 0;
         mWritePos = 0;
-        auto pagesize = sysconf(_SC_PAGE_SIZE);
-        auto bufsize = util::nextMultiple(tCapacity, pagesize / sizeof(sam_t));
-        mBuffer.resize(bufsize);
         mCapacity = tCapacity;
+        releaseChunks((tCapacity + mChunkMask) >> mChunkShift); // keeps those likely needed again
+    }
+
+    // the decoder is done, the length written is the actual length
+    void finish() {
+        mCapacity = mWritePos.load();
+    }
+
+    // reads a cached file from tOffset on, completely written and without owning memory
+    void map(std::shared_ptr<const PCMCache::Entry> tEntry, size_t tOffset = 0) requires std::is_same_v<T, sam_t> {
+        std::lock_guard<std::mutex> lock(mMutex);
+        moveLockWindow(0, 0);
+        releaseChunks(0);
+        mPlayedEnd = 0;
+        unshare();
+        tOffset = std::min(tOffset, tEntry->sampleCount());
+        mEntry = std::move(tEntry);
+        mData = mEntry->data() + tOffset;
+        mPrefetchEnd = 0;
+        mCapacity = mEntry->sampleCount() - tOffset;
+        mReadPos = 0;
+        mWritePos = mCapacity.load();
+    }
+
+    // locks the chunk before the read head up to the chunk holding tAhead samples ahead (as far as written)
+    void lockWindow(size_t tAhead) override {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (tAhead == 0) {
+            moveLockWindow(0, 0);
+            return;
+        }
+        size_t readPos = mReadPos;
+        size_t written = mWritePos;
+        auto begin = readPos >> mChunkShift;
+        auto end = std::min((readPos + tAhead + mChunkMask) >> mChunkShift, (written + mChunkMask) >> mChunkShift);
+        begin = std::min(std::max(begin > 0 ? begin - 1 : 0, mPlayedEnd), end); // released chunks stay out
+        moveLockWindow(begin, end);
+    }
+
+    // reads the pages of a mapped file from the read head up to tAhead samples ahead in, so the render thread
+    // doesn't fault on the disk (chunks are in memory already); only the part not read in before is touched
+    void prefetch(size_t tAhead) override {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (!mData) return;
+        size_t readPos = mReadPos;
+        auto begin = std::max(mPrefetchEnd, readPos);
+        auto end = std::min(readPos + tAhead, mWritePos.load());
+        if (end <= begin) return;
+        util::MemoryPages::populate(mData + begin, (end - begin) * sizeof(T));
+        mPrefetchEnd = end;
+    }
+
+    // reads the samples of a finished buffer (not shared itself, same storage format, complete) from the start
+    bool share(std::shared_ptr<FileBuffer> tSource) {
+        if (!tSource || tSource->mShared || tSource->mCompact != mCompact || tSource.get() == this) return false;
+        std::lock_guard<std::mutex> lock(mMutex);
+        moveLockWindow(0, 0);
+        unshare();
+        releaseChunks(0);
+        mPlayedEnd = 0;
+        mEntry = nullptr;
+        mData = nullptr;
+        mReadPos = 0;
+        mWritePos = 0;
+        mCapacity = 0;
+        {
+            std::lock_guard<std::mutex> storageLock(tSource->mStorageMutex);
+            if (tSource->mTruncated) return false;
+            tSource->mReaders.push_back(this);
+        }
+        mEntry = tSource->mEntry;
+        mData = tSource->mData;
+        mPrefetchEnd = 0;
+        mTable.store(tSource->mTable.load(std::memory_order_acquire), std::memory_order_release);
+        mShared = std::move(tSource);
+        mCapacity = mShared->mCapacity.load();
+        mReadPos = 0;
+        mWritePos = mCapacity.load();
+        return true;
+    }
+
+    bool isShared() const {
+        return mShared != nullptr;
+    }
+
+    // gives back the memory of chunks completely played more than tMargin samples ago
+    // (to the pool, or to the page cache if mapped)
+    void releasePlayed(size_t tMargin) override {
+        std::lock_guard<std::mutex> lock(mMutex);
+        size_t readPos = mReadPos;
+        if (readPos <= tMargin) return;
+        auto end = (readPos - tMargin) >> mChunkShift;
+        if (mPlayedEnd >= end) return;
+        if (mShared) {
+            std::lock_guard<std::mutex> storageLock(mShared->mStorageMutex);
+            if (mShared->mReaders.size() > 1) return; // still read by others
+            mShared->mTruncated = true;
+        }
+        auto& storage = mShared ? *mShared : *this;
+        for (; mPlayedEnd < end; ++mPlayedEnd) {
+            auto i = mPlayedEnd;
+            if (i < mLocked.size() && mLocked[i]) {
+                storage.dropLock(i);
+                mLocked[i] = false;
+            }
+            storage.releaseChunk(i);
+        }
     }
 
     size_t write(const T* tData, size_t tLen) override {
-        auto writable = std::min(tLen, mCapacity - mWritePos);
-        if (writable == 0) return 0;
-        memcpy(&mBuffer[mWritePos], tData, writable * sizeof(T));
-        mWritePos += writable;
-        return writable;
+        if (mEntry || mShared || tLen == 0) return 0;
+        size_t pos = mWritePos;
+        store(pos, tData, tLen);
+        mWritePos = pos + tLen;
+        if (mCapacity < pos + tLen) mCapacity = pos + tLen;
+        return tLen;
+    }
+
+    // up to the end of the current chunk, stored as T only
+    std::span<T> writeSpan(size_t tLen) override {
+        if (mEntry || mShared || mCompact || tLen == 0) return {};
+        size_t pos = mWritePos;
+        auto len = std::min(tLen, mChunkMask + 1 - (pos & mChunkMask));
+        reserve(pos, pos + len);
+        return {static_cast<T*>(mTables.back()[pos >> mChunkShift]) + (pos & mChunkMask), len};
+    }
+
+    void commitWrite(size_t tLen) override {
+        size_t pos = mWritePos;
+        mWritePos = pos + tLen;
+        if (mCapacity < pos + tLen) mCapacity = pos + tLen;
+    }
+
+    // adds chunks for tEnd samples, so several threads can fill disjoint ranges below with writeAt()
+    void prepare(size_t tEnd) {
+        reserve(mWritePos, tEnd);
+    }
+
+    // writes tLen samples at tPos within the prepared length, without moving the write position
+    void writeAt(size_t tPos, const T* tData, size_t tLen) {
+        if (mCompact) {
+            forEachSpan<int16_t>(tPos, tLen, [&](int16_t* dst, size_t offset, size_t len) { kernels::toInt16(dst, tData + offset, len); });
+        } else {
+            forEachSpan<T>(tPos, tLen, [&](T* dst, size_t offset, size_t len) { memcpy(dst, tData + offset, len * sizeof(T)); });
+        }
     }
 
     size_t read(T* tData, size_t tLen) override {
         auto readable = std::min(tLen, mWritePos - mReadPos);
         if (readable == 0) return 0;
-        memcpy(tData, &mBuffer[mReadPos], readable * sizeof(T));
+        copy(mReadPos, tData, readable);
+        mReadPos += readable;
+
+        return readable;
+    }
+
+    size_t mix(T* tData, size_t tLen, const float* tGain, size_t tChannels) override {
+        auto readable = std::min(tLen, mWritePos - mReadPos);
+        readable -= readable % tChannels;
+        if (readable == 0) return 0;
+        if (mData) {
+            kernels::mixRamp(tData, &mData[mReadPos], readable, tGain, tChannels);
+        } else if (mCompact) {
+            forEachSpan<int16_t>(mReadPos, readable, [&](int16_t* src, size_t offset, size_t len) { kernels::mixRampInt16(tData + offset, src, len, tGain + offset / tChannels, tChannels); });
+        } else {
+            forEachSpan<T>(mReadPos, readable, [&](T* src, size_t offset, size_t len) { kernels::mixRamp(tData + offset, src, len, tGain + offset / tChannels, tChannels); });
+        }
         mReadPos += readable;
 
         return readable;
     }
+
+protected:
+    // moves both positions back to the start, the next release of played chunks starts there as well
+    void rewind() {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mWritePos = 0;
+        mReadPos = 0;
+        mPlayedEnd = 0;
+    }
+
+    // writes tLen samples at tPos (adding chunks as needed), without moving the write position
+    void store(size_t tPos, const T* tData, size_t tLen) {
+        reserve(tPos, tPos + tLen);
+        writeAt(tPos, tData, tLen);
+    }
+
+    // applies tFunction(samples, offset, len) in place to the samples of [tPos, tPos + tLen)
+    // (converted copies of up to kScratchSize samples with compact storage), writer side only
+    template <typename F>
+    void transform(size_t tPos, size_t tLen, F&& tFunction) {
+        reserve(tPos, tPos + tLen);
+        if (!mCompact) {
+            forEachSpan<T>(tPos, tLen, tFunction);
+            return;
+        }
+        mScratch.resize(kScratchSize);
+        forEachSpan<int16_t>(tPos, tLen, [&](int16_t* data, size_t offset, size_t len) {
+            for (size_t i = 0; i < len; i += kScratchSize) {
+                auto n = std::min(kScratchSize, len - i);
+                kernels::fromInt16(mScratch.data(), data + i, n);
+                tFunction(mScratch.data(), offset + i, n);
+                kernels::toInt16(data + i, mScratch.data(), n);
+            }
+        });
+    }
+
+private:
+    // calls tFunction(storage, offset, len) for each contiguous piece of [tPos, tPos + tLen)
+    template <typename S, typename F>
+    void forEachSpan(size_t tPos, size_t tLen, F&& tFunction) const {
+        auto table = mTable.load(std::memory_order_acquire);
+        size_t offset = 0;
+        while (offset < tLen) {
+            auto pos = tPos + offset;
+            auto len = std::min(tLen - offset, mChunkMask + 1 - (pos & mChunkMask));
+            tFunction(static_cast<S*>(table[pos >> mChunkShift]) + (pos & mChunkMask), offset, len);
+            offset += len;
+        }
+    }
+
+    // makes sure chunks cover [tBegin, tEnd); a grown table is published before any position refers to it
+    void reserve(size_t tBegin, size_t tEnd) {
+        auto chunks = (tEnd + mChunkMask) >> mChunkShift;
+        if (mReleased > 0) {
+            // released after playing, written again after a rewind (never near the release range)
+            auto table = mTables.back().get();
+            for (auto i = tBegin >> mChunkShift; i < std::min(chunks, mChunkCount); ++i) {
+                if (table[i]) continue;
+                table[i] = mPool->acquire();
+                --mReleased;
+            }
+        }
+        if (chunks <= mChunkCount) return;
+        if (chunks > mTableSize) {
+            std::lock_guard<std::mutex> lock(mMutex);
+            auto size = std::max({chunks, mTableSize * 2, size_t(16)});
+            auto table = std::make_unique<void*[]>(size);
+            if (mTableSize) std::copy_n(mTables.back().get(), mTableSize, table.get());
+            mTable.store(table.get(), std::memory_order_release);
+            mTables.push_back(std::move(table));
+            mTableSize = size;
+        }
+        auto table = mTables.back().get();
+        while (mChunkCount < chunks) table[mChunkCount++] = mPool->acquire();
+    }
+
+    size_t ownedBytes() const {
+        return (mChunkCount - mReleased) * util::ChunkPool::kChunkSize + (mEntry ? mEntry->bytes() : 0);
+    }
+
+    // gives back a played chunk (to the pool, or its pages to the page cache if mapped), storage side
+    void releaseChunk(size_t tIndex) {
+        if (mData) {
+            util::MemoryPages::discard(mData + (tIndex << mChunkShift), (mChunkMask + 1) * sizeof(T));
+            return;
+        }
+        auto table = mTables.back().get();
+        if (!table[tIndex]) return;
+        mPool->release(table[tIndex]);
+        table[tIndex] = nullptr;
+        ++mReleased;
+    }
+
+    // reads own chunks again
+    void unshare() {
+        if (!mShared) return;
+        {
+            std::lock_guard<std::mutex> storageLock(mShared->mStorageMutex);
+            std::erase(mShared->mReaders, this);
+        }
+        mShared = nullptr;
+        mTable.store(mTables.empty() ? nullptr : mTables.back().get(), std::memory_order_release);
+    }
+
+    // unlocks the chunks leaving [tBegin, tEnd) and locks those entering it, stops at the lock limit
+    void moveLockWindow(size_t tBegin, size_t tEnd) {
+        auto& storage = mShared ? *mShared : *this;
+        for (auto i = mLockBegin; i < mLockEnd; ++i) {
+            if (mLocked[i] && (i < tBegin || i >= tEnd)) {
+                storage.dropLock(i);
+                mLocked[i] = false;
+            }
+        }
+        if (mLocked.size() < tEnd) mLocked.resize(tEnd);
+        for (auto i = tBegin; i < tEnd; ++i) {
+            if (mLocked[i]) continue;
+            if (!storage.retainLock(i)) break;
+            mLocked[i] = true;
+        }
+        mLockBegin = tBegin;
+        mLockEnd = tEnd;
+    }
+
+    // storage side: mlock doesn't nest, so a chunk stays locked while any reader holds it
+    bool retainLock(size_t tIndex) {
+        std::lock_guard<std::mutex> storageLock(mStorageMutex);
+        if (mLockCounts.size() <= tIndex) mLockCounts.resize(tIndex + 1);
+        if (mLockCounts[tIndex] == 0 && !lockChunk(tIndex, true)) return false;
+        ++mLockCounts[tIndex];
+        return true;
+    }
+
+    void dropLock(size_t tIndex) {
+        std::lock_guard<std::mutex> storageLock(mStorageMutex);
+        if (tIndex >= mLockCounts.size() || mLockCounts[tIndex] == 0) return;
+        if (--mLockCounts[tIndex] == 0) lockChunk(tIndex, false);
+    }
+
+    bool lockChunk(size_t tIndex, bool tLock) {
+        const void* addr;
+        size_t bytes;
+        if (mData) {
+            auto pos = tIndex << mChunkShift;
+            addr = mData + pos;
+            bytes = std::min(mChunkMask + 1, mCapacity - pos) * sizeof(T);
+        } else {
+            addr = mTable.load(std::memory_order_acquire)[tIndex];
+            bytes = util::ChunkPool::kChunkSize;
+        }
+        if (!tLock) {
+            util::MemoryPages::unlock(addr, bytes);
+            return true;
+        }
+        return util::MemoryPages::lock(addr, bytes);
+    }
+
+    // returns the chunks from index tKeep on to the pool
+    void releaseChunks(size_t tKeep) {
+        if (mTables.empty()) return;
+        auto table = mTables.back().get();
+        while (mChunkCount > tKeep) {
+            if (auto chunk = table[--mChunkCount]) mPool->release(chunk);
+            else --mReleased;
+            table[mChunkCount] = nullptr;
+        }
+    }
+};
+
+// Range of a FileBuffer filled by one reader of a parallel decode: the reader's preroll is dropped and the
+// range ends where the next segment begins (short writes stop the reader), or is appended if it is the last one.
+template <typename T>
+class FileSegmentWriter : public SourceBuffer<T> {
+    FileBuffer<T>& mTarget;
+    const size_t mBegin;
+    const size_t mEnd; // 0 appends
+    size_t mSkip;
+    size_t mWritten = 0;
+
+public:
+    FileSegmentWriter(FileBuffer<T>& tTarget, size_t tBegin, size_t tEnd, size_t tSkip = 0) :
+        mTarget(tTarget),
+        mBegin(tBegin),
+        mEnd(tEnd),
+        mSkip(tSkip)
+    {}
+
+    size_t writePosition() override { return mWritten; }
+
+    bool isFilled() const {
+        return mEnd == 0 || mBegin + mWritten == mEnd;
+    }
+
+    std::span<T> writeSpan(size_t tLen) override {
+        if (mSkip > 0 || mEnd > 0) return {};
+        return mTarget.writeSpan(tLen);
+    }
+
+    void commitWrite(size_t tLen) override {
+        mTarget.commitWrite(tLen);
+        mWritten += tLen;
+    }
+
+    size_t write(const T* tData, size_t tLen) override {
+        auto skip = std::min(mSkip, tLen);
+        mSkip -= skip;
+        tData += skip;
+        tLen -= skip;
+        if (tLen == 0) return skip;
+        if (mEnd == 0) {
+            auto written = mTarget.write(tData, tLen);
+            mWritten += written;
+            return skip + written;
+        }
+        auto len = std::min(tLen, mEnd - mBegin - mWritten);
+        mTarget.writeAt(mBegin + mWritten, tData, len);
+        mWritten += len;
+        return skip + len;
+    }
+
+    size_t read(T* tData, size_t tLen) override { return 0; }
+    size_t mix(T* tData, size_t tLen, const float* tGain, size_t tChannels) override { return 0; }
+};
+
+// Bounded window of a file decoded just in time. The decoder thread stays up to the window size
+// ahead of the read head and polls for room; the render thread consumes lock-free.
+// Positions and capacity count samples of the whole item, so progress reads like a FileBuffer.
+template <typename T>
+class FileStreamBuffer : public SourceBuffer<T> {
+    static constexpr auto kRefillInterval = std::chrono::milliseconds(20);
+
+    const size_t mWindow;
+    std::unique_ptr<util::SPSCRing<T>> mRing = nullptr;
+    std::atomic<size_t> mReadPos = 0;
+    std::atomic<size_t> mWritePos = 0;
+    std::atomic<bool> mCancelled = false;
+    std::atomic<bool> mComplete = false;
+    size_t mCapacity = 0;
+
+public:
+    FileStreamBuffer(size_t tWindow) :
+        mWindow(tWindow)
+    {}
+
+    size_t readPosition() override { return mReadPos; }
+    size_t writePosition() override { return mWritePos; }
+    size_t capacity() override { return mCapacity; }
+
+    size_t memorySize() override {
+        return mRing ? mRing->capacity() * sizeof(T) : 0;
+    }
+
+    // samples decoded ahead of the read head
+    size_t available() const {
+        return mRing ? mRing->size() : 0;
+    }
+
+    size_t window() const {
+        return mRing ? mRing->capacity() : 0;
+    }
+
+    bool isComplete() const {
+        return mComplete;
+    }
+
+    void resize(size_t tCapacity) override {
+        mRing = std::make_unique<util::SPSCRing<T>>(std::min(tCapacity, mWindow));
+        mReadPos = 0;
+        mWritePos = 0;
+        mCapacity = tCapacity;
+        mCancelled = false;
+        mComplete = false;
+    }
+
+    void cancel() {
+        mCancelled = true;
+    }
+
+    // drops the window until the next resize
+    void clear() {
+        mRing = nullptr;
+        mReadPos = 0;
+        mWritePos = 0;
+        mCapacity = 0;
+    }
+
+    // decoder reached the end of the file (or gave up)
+    void finish() {
+        mComplete = true;
+    }
+
+    size_t write(const T* tData, size_t tLen) override {
+        if (!mRing || tLen > mRing->capacity()) return 0;
+        while (mRing->writable() < tLen) {
+            if (mCancelled) return 0;
+            std::this_thread::sleep_for(kRefillInterval);
+        }
+        if (mCancelled) return 0;
+        mRing->write(tData, tLen);
+        mWritePos.fetch_add(tLen, std::memory_order_relaxed);
+        return tLen;
+    }
+
+    size_t read(T* tData, size_t tLen) override {
+        if (!mRing) return 0;
+        auto readable = mRing->read(tData, tLen);
+        mReadPos.fetch_add(readable, std::memory_order_relaxed);
+        return readable;
+    }
+
+    size_t mix(T* tData, size_t tLen, const float* tGain, size_t tChannels) override {
+        if (!mRing) return 0;
+        auto readable = std::min(tLen, mRing->size());
+        readable -= readable % tChannels;
+        if (readable == 0) return 0;
+        size_t offset = 0;
+        mRing->peek(readable, [&](const T* data, size_t len) {
+            kernels::mixRamp(tData + offset, data, len, tGain + offset / tChannels, tChannels); // ring capacity is pow2, spans stay frame aligned
+            offset += len;
+        });
+        mRing->consume(readable);
+        mReadPos.fetch_add(readable, std::memory_order_relaxed);
+        return readable;
+    }
 };
 
 class FilePlayer : public Player {
 
+    static constexpr double kMinSegmentTime = 300; // sec. decoded per thread at least, shorter files are decoded by one reader
+    static constexpr double kSegmentPreroll = 2; // sec. decoded ahead of a segment and dropped, to settle decoder and resampler
+
+    const double mStreamThreshold;
+    const size_t mDecodeThreads;
     FileBuffer<sam_t> mFileBuffer;
+    FileStreamBuffer<sam_t> mStreamBuffer;
     std::unique_ptr<CodecReader> mReader = nullptr;
+    std::thread mDecodeWorker;
+    std::mutex mReaderMutex; // guards mReader and mSegmentReaders, cancelled from other threads while loading
+    std::vector<std::unique_ptr<CodecReader>> mSegmentReaders; // of a parallel decode, cancelled with mReader
+    bool mStreaming = false;
+    bool mStreamDecoding = false; // mReader decodes for playback, load() has returned (guarded by mReaderMutex)
 
 public:
-    FilePlayer(const AudioStreamFormat& tClientFormat, const std::string tName = "", time_t tPreloadTime = 0, float tFadeInTime = 0, float tFadeOutTime = 0) :
-        Player(tClientFormat, tName, tPreloadTime, tFadeInTime, tFadeOutTime)
+    // items longer than tStreamThreshold seconds (0 = never) are decoded just in time, tStreamLookahead seconds ahead of playback
+    // tCompact keeps preloaded samples in 16 bit
+    // long local files are decoded in segments by up to tDecodeThreads readers in parallel (0 = one per core)
+    FilePlayer(const AudioStreamFormat& tClientFormat, const std::string tName = "", time_t tPreloadTime = 0, float tFadeInTime = 0, float tFadeOutTime = 0, double tStreamThreshold = 0, double tStreamLookahead = 30, bool tCompact = false, size_t tDecodeThreads = 1, std::shared_ptr<util::ChunkPool> tPool = util::ChunkPool::shared()) :
+        Player(tClientFormat, tName, tPreloadTime, tFadeInTime, tFadeOutTime),
+        mStreamThreshold(tStreamThreshold),
+        mDecodeThreads(tDecodeThreads > 0 ? tDecodeThreads : std::max(std::thread::hardware_concurrency(), 1u)),
+        mFileBuffer(tCompact, std::move(tPool)),
+        mStreamBuffer(static_cast<size_t>(tStreamLookahead * tClientFormat.sampleRate) * tClientFormat.channelCount)
     {
         category = "FILE";
         mBuffer = &mFileBuffer;
@@ -95,34 +672,249 @@ public:
     ~FilePlayer() {
         log.debug() << "FilePlayer " << name << " dealloc...";
         if (state != IDLE) stop();
+        joinDecoder();
         log.debug() << "FilePlayer " << name << " dealloced";
     }
 
+    bool canRenderAhead() const override {
+        return true;
+    }
+
+    // streaming playback has caught up with the decoder
+    bool isStarved() const override {
+        return mStreaming && isPlaying() && !mStreamBuffer.isComplete() && mStreamBuffer.available() < mStreamBuffer.window() / 2;
+    }
+
+    double loadWork() const override {
+        if (!playItem) return 0;
+        auto duration = static_cast<double>(playItem->end - playItem->start);
+        if (mStreamThreshold > 0 && duration > mStreamThreshold) return 0; // opened only, decoded while playing
+        return duration;
+    }
+
     void load(const std::string& tURL, double seek = 0) override {
         log.info() << "FilePlayer load " << tURL << " position " << seek;
         // eject();
+        decodedDuration = 0;
 
-        if (mReader) mReader->cancel();
-        mReader = std::make_unique<CodecReader>(clientFormat, tURL, seek);
+        joinDecoder();
+        // decoder threads for a complete decode only, a streaming reader stays open until its item has played
+        auto threads = loadWork() > 0 ? static_cast<int>(mDecodeThreads) : 1;
+        replaceReader(std::make_unique<CodecReader>(clientFormat, tURL, seek, threads));
 
         if (playItem) playItem->metadata = mReader->metadata();
 
+        auto offset = static_cast<size_t>(seek * clientFormat.sampleRate) * clientFormat.channelCount;
+        auto shareKey = sharedPCM ? SharedPCM::key(tURL, offset, mFileBuffer.isCompact()) : "";
+        if (auto shared = sharedPCM ? sharedPCM->find(shareKey) : nullptr; shared && mFileBuffer.share(shared)) {
+            // held by another player already
+            mStreaming = false;
+            mBuffer = &mFileBuffer;
+            replaceReader();
+            log.debug() << "FilePlayer load done " << tURL << " (shared)";
+            return;
+        }
+
+        // taken before decoding, so a file replaced meanwhile is not stored under its new identity
+        auto cacheKey = pcmCache ? pcmCache->key(tURL) : std::nullopt;
+        if (auto entry = cacheKey ? pcmCache->find(*cacheKey) : nullptr) {
+            // decoded before, mapped regardless of the duration
+            mStreaming = false;
+            mBuffer = &mFileBuffer;
+            mFileBuffer.map(entry, offset);
+            mFileBuffer.prefetch(mStreamBuffer.window()); // on this thread, the rest follows ahead of playback
+            replaceReader();
+            log.debug() << "FilePlayer load done " << tURL << " (cached)";
+            return;
+        }
+
         auto sampleCount = mReader->sampleCount();
-        mFileBuffer.resize(sampleCount);
-        mReader->read(mFileBuffer);
-        mReader = nullptr;
+        mStreaming = mStreamThreshold > 0 && mReader->duration() > mStreamThreshold;
+        if (mStreaming) {
+            // opened and positioned now, decoded while playing
+            mStreamBuffer.resize(sampleCount);
+            mBuffer = &mStreamBuffer; // not rendered before the player is cued
+            {
+                std::lock_guard<std::mutex> lock(mReaderMutex);
+                mStreamDecoding = true; // no longer part of the load, cancelled by stop() only
+            }
+            mDecodeWorker = std::thread([this, tURL] {
+                try {
+                    mReader->read(mStreamBuffer);
+                }
+                catch (const std::exception& e) {
+                    log.error() << "FilePlayer streaming decode of '" << tURL << "' failed: " << e.what(); // plays what was decoded
+                }
+                mStreamBuffer.finish();
+            });
+            log.debug() << "FilePlayer streaming " << tURL << " with " << mStreamBuffer.memorySizeMiB() << " MiB lookahead";
+            return;
+        }
+
+        // decoded into a buffer of its own when it can be shared, released with the last player reading it
+        auto decoded = shareKey.empty() ? nullptr : std::make_shared<FileBuffer<sam_t>>(mFileBuffer.isCompact(), mFileBuffer.pool());
+        auto& buffer = decoded ? *decoded : mFileBuffer;
+        mBuffer = &mFileBuffer;
+        if (decoded) mFileBuffer.resize(0);
+        buffer.resize(sampleCount);
+        auto complete = seek == 0 ? readSegmented(buffer, tURL) : mReader->read(buffer);
+        if (mReader->isCancelled()) {
+            // obsolete, the partly decoded samples go back to the pool right away
+            replaceReader();
+            mFileBuffer.resize(0);
+            throw std::runtime_error("FilePlayer load of " + tURL + " cancelled");
+        }
+        buffer.finish();
+        replaceReader();
+        decodedDuration = static_cast<double>(buffer.writePosition()) / (clientFormat.sampleRate * clientFormat.channelCount);
+        if (decoded) {
+            mFileBuffer.share(decoded);
+            if (complete) sharedPCM->publish(shareKey, decoded);
+        }
+        if (complete && cacheKey && seek == 0) {
+            pcmCache->store(*cacheKey, mFileBuffer.writePosition(), [this](sam_t* data, size_t pos, size_t len) { mFileBuffer.copy(pos, data, len); });
+        }
 
         log.debug() << "FilePlayer load done " << tURL;
     }
 
+    // releases the decoded samples to the pool
+    void recycle() override {
+        Player::recycle();
+        joinDecoder();
+        replaceReader();
+        mFileBuffer.resize(0);
+        mStreamBuffer.clear();
+        mStreaming = false;
+        mBuffer = &mFileBuffer;
+    }
+
     void stop() override {
         log.debug() << "FilePlayer " << name << " stop...";
         Player::stop();
-        if (mReader) mReader->cancel();
-        mReader = nullptr;
-        // mBuffer.reset();
+        mStreamBuffer.cancel();
+        cancelReaders();
         log.debug() << "FilePlayer " << name << " stopped";
     }
+
+    // a preemption may still pick the player once load() has returned, the stream decoder keeps running then
+    void cancelLoad() override {
+        Player::cancelLoad();
+        cancelReaders(true);
+    }
+
+private:
+    // decodes segments of whole seconds in parallel, each after a preroll that is dropped, so that
+    // every reader starts feeding its resampler at a known input sample and the segments join sample-accurately;
+    // falls back to one reader for short or remote files (and if a segment comes up short)
+    bool readSegmented(FileBuffer<sam_t>& tBuffer, const std::string& tURL) {
+        auto duration = mReader->duration();
+        auto segments = std::min(mDecodeThreads, static_cast<size_t>(duration / kMinSegmentTime));
+        if (segments < 2 || !mReader->isSeekable()) return mReader->read(tBuffer);
+
+        auto length = std::ceil(duration / segments);
+        auto samplesPerSecond = static_cast<size_t>(clientFormat.sampleRate) * clientFormat.channelCount;
+        auto segmentSize = static_cast<size_t>(length) * samplesPerSecond;
+        auto prerollSize = static_cast<size_t>(kSegmentPreroll) * samplesPerSecond;
+        log.debug() << "FilePlayer decoding " << tURL << " in " << segments << " segments";
+
+        std::vector<std::unique_ptr<CodecReader>> readers;
+        for (size_t i = 1; i < segments; ++i) {
+            auto start = i * length - kSegmentPreroll;
+            auto reader = std::make_unique<CodecReader>(clientFormat, tURL, start, 1);
+            reader->skipUntil(start);
+            readers.push_back(std::move(reader));
+        }
+        {
+            std::lock_guard<std::mutex> lock(mReaderMutex);
+            mSegmentReaders = std::move(readers);
+            if (mReader->isCancelled()) for (const auto& reader : mSegmentReaders) reader->cancel();
+        }
+
+        // the last segment appends from its start on and may run past the expected duration
+        auto lastBegin = (segments - 1) * segmentSize;
+        tBuffer.prepare(lastBegin);
+        tBuffer.commitWrite(lastBegin);
+
+        // a segment failing (e.g. out of chunks) stays incomplete and is decoded again sequentially
+        std::vector<char> complete(segments, false);
+        std::vector<std::thread> workers;
+        auto finishWorkers = [&] {
+            for (auto& worker : workers) worker.join();
+            std::lock_guard<std::mutex> lock(mReaderMutex);
+            mSegmentReaders.clear();
+        };
+        try {
+            for (size_t i = 1; i < segments; ++i) {
+                workers.emplace_back([&, i] {
+                    try {
+                        auto last = i == segments - 1;
+                        FileSegmentWriter<sam_t> writer(tBuffer, i * segmentSize, last ? 0 : (i + 1) * segmentSize, prerollSize);
+                        auto eof = mSegmentReaders[i - 1]->read(writer);
+                        complete[i] = last ? eof : writer.isFilled();
+                    }
+                    catch (const std::exception& e) {
+                        log.warn() << "FilePlayer segment " << i << " of " << tURL << " failed: " << e.what();
+                    }
+                });
+            }
+            FileSegmentWriter<sam_t> first(tBuffer, 0, segmentSize);
+            mReader->read(first);
+            complete[0] = first.isFilled();
+        }
+        catch (...) {
+            // the workers write into tBuffer, they are stopped before the exception leaves
+            {
+                std::lock_guard<std::mutex> lock(mReaderMutex);
+                for (const auto& reader : mSegmentReaders) reader->cancel();
+            }
+            finishWorkers();
+            throw;
+        }
+        finishWorkers();
+
+        auto cancelled = mReader->isCancelled();
+        if (std::all_of(complete.begin(), complete.end(), [](auto c) { return c; })) return true;
+        if (cancelled) return false;
+
+        log.warn() << "FilePlayer segmented decode of " << tURL << " incomplete, decoding sequentially";
+        auto reader = std::make_unique<CodecReader>(clientFormat, tURL, 0, static_cast<int>(mDecodeThreads));
+        {
+            std::lock_guard<std::mutex> lock(mReaderMutex); // replaced while it may be cancelled
+            if (mReader->isCancelled()) return false;
+            std::swap(mReader, reader);
+        }
+        retire(reader);
+        tBuffer.resize(mReader->sampleCount());
+        return mReader->read(tBuffer);
+    }
+
+    // swaps the reader under mReaderMutex, as cancelReaders may reach it from other threads,
+    // and retires the previous one outside of it
+    void replaceReader(std::unique_ptr<CodecReader> tReader = nullptr) {
+        {
+            std::lock_guard<std::mutex> lock(mReaderMutex);
+            std::swap(mReader, tReader);
+            mStreamDecoding = false;
+        }
+        retire(tReader);
+    }
+
+    // tLoadOnly spares the decoder of a streaming item that is loaded already
+    void cancelReaders(bool tLoadOnly = false) {
+        std::lock_guard<std::mutex> lock(mReaderMutex);
+        if (tLoadOnly && mStreamDecoding) return;
+        if (mReader) mReader->cancel(); // released by the load thread once read returns
+        for (const auto& reader : mSegmentReaders) reader->cancel();
+    }
+
+    void joinDecoder() {
+        if (!mDecodeWorker.joinable()) return;
+        mStreamBuffer.cancel();
+        cancelReaders();
+        mDecodeWorker.join();
+        replaceReader();
+    }
 };
 }
 }
\ No newline at end of file
@@ -0,0 +1,229 @@
+/*
+ *  Copyright (C) 2024-2025 Christoph Pastl
+ *
+ *  This file is part of Castor.
+ *
+ *  Castor is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Castor is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ *  If you use this program over a network, you must also offer access
+ *  to the source code under the terms of the GNU Lesser General Public License.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+#include "AudioClient.hpp"
+#include "CodecWriter.hpp"
+#include "audio.hpp"
+#include "../util/EngineClock.hpp"
+#include "../util/Log.hpp"
+#include "../util/RTGuard.hpp"
+#include "../util/util.hpp"
+
+namespace castor {
+namespace audio {
+
+// Drives a renderer without an audio device. Blocks are rendered back to back on the virtual engine
+// clock, which advances by one block after each callback, so a day of schedule runs in minutes.
+// Before each block the driver waits until readyCallback reports that the engine has caught up with
+// the clock (timers fired, imminent items loaded). The input is silent; the output is encoded to
+// mp3/aac/ogg/flac by file extension, written as raw interleaved 32-bit float otherwise, or dropped
+// for the url "null".
+class HeadlessClient {
+
+    static constexpr size_t kWriterBufferSeconds = 10;
+    static constexpr int kWriterBitRate = 320000;
+    static constexpr auto kReadyPollInterval = std::chrono::microseconds(100);
+    static constexpr auto kReadyTimeout = std::chrono::seconds(10);
+    static constexpr auto kDrainTimeout = std::chrono::seconds(5);
+    static constexpr time_t kProgressInterval = 3600;
+
+    const AudioStreamFormat& mClientFormat;
+    const std::string mURL;
+    const double mDuration;
+    const double mSpeed;
+    Client::Renderer* mRenderer = nullptr;
+    std::atomic<bool> mRunning = false;
+    std::atomic<uint64_t> mFramesRendered = 0;
+    std::atomic<uint64_t> mReadyTimeouts = 0;
+    std::thread mWorker;
+    std::vector<sam_t> mIn;
+    std::vector<sam_t> mOut;
+    std::ofstream mRawFile;
+    util::RingBuffer<sam_t> mWriterBuffer;
+    std::unique_ptr<CodecWriter> mWriter = nullptr;
+    std::thread mWriterThread;
+
+public:
+
+    std::function<bool()> readyCallback;
+    std::function<void()> finishedCallback;
+
+    // tDuration in seconds of engine time, tSpeed as multiple of real time (0 = as fast as possible)
+    HeadlessClient(const AudioStreamFormat& tClientFormat, const std::string& tURL, double tDuration, double tSpeed = 0) :
+        mClientFormat(tClientFormat),
+        mURL(tURL),
+        mDuration(tDuration),
+        mSpeed(tSpeed),
+        mIn(tClientFormat.frameSize * tClientFormat.channelCount),
+        mOut(tClientFormat.frameSize * tClientFormat.channelCount),
+        mWriterBuffer(kWriterBufferSeconds * tClientFormat.sampleRate * tClientFormat.channelCount)
+    {}
+
+    ~HeadlessClient() {
+        stop();
+    }
+
+    void setRenderer(Client::Renderer* tRenderer) {
+        mRenderer = tRenderer;
+    }
+
+    void start() {
+        log.debug() << "HeadlessClient start";
+        if (!mRenderer) throw std::runtime_error("HeadlessClient has no renderer");
+        if (!util::EngineClock::isVirtual()) throw std::runtime_error("HeadlessClient requires the virtual engine clock");
+        openOutput();
+        mRunning = true;
+        mWorker = std::thread(&HeadlessClient::run, this);
+        log.info() << "HeadlessClient rendering " << mDuration << " s to " << mURL << " at " << (mSpeed > 0 ? std::to_string(mSpeed) + "x" : "full") << " speed";
+    }
+
+    void stop() {
+        mRunning = false;
+        if (mWorker.joinable()) mWorker.join();
+        util::EngineClock::release();
+        closeOutput();
+    }
+
+    uint64_t framesRendered() const {
+        return mFramesRendered.load(std::memory_order_relaxed);
+    }
+
+    uint64_t readyTimeouts() const {
+        return mReadyTimeouts.load(std::memory_order_relaxed);
+    }
+
+private:
+    void openOutput() {
+        using util::FileType;
+        auto fileType = util::getFileType(mURL);
+        if (mURL.empty() || mURL == "null") return;
+        if (fileType == FileType::MP3 || fileType == FileType::AAC || fileType == FileType::OGG || fileType == FileType::FLAC) {
+            mWriter = std::make_unique<CodecWriter>(mClientFormat, kWriterBitRate, mURL);
+            mWriterThread = std::thread([this] {
+                try {
+                    mWriter->write(mWriterBuffer);
+                }
+                catch (const std::exception& e) {
+                    log.error() << "HeadlessClient writer error: " << e.what();
+                }
+            });
+            return;
+        }
+        mRawFile.open(mURL, std::ios::binary | std::ios::trunc);
+        if (!mRawFile.is_open()) throw std::runtime_error("HeadlessClient failed to open output file " + mURL);
+    }
+
+    void closeOutput() {
+        if (mWriter) {
+            // let the writer drain, all but a partial codec frame
+            auto deadline = std::chrono::steady_clock::now() + kDrainTimeout;
+            auto remaining = mWriterBuffer.size();
+            while (std::chrono::steady_clock::now() < deadline) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(50));
+                auto size = mWriterBuffer.size();
+                if (size == remaining) break;
+                remaining = size;
+            }
+            mWriter->cancel();
+            if (mWriterThread.joinable()) mWriterThread.join();
+            mWriter = nullptr;
+        }
+        if (mRawFile.is_open()) mRawFile.close();
+    }
+
+    void output(size_t nsamples) {
+        if (mWriter) {
+            // never overwrite unwritten audio: wait for the encoder instead
+            while (mWriterBuffer.capacity() - mWriterBuffer.size() < nsamples) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            mWriterBuffer.write(mOut.data(), nsamples);
+        } else if (mRawFile.is_open()) {
+            mRawFile.write(reinterpret_cast<const char*>(mOut.data()), nsamples * sizeof(sam_t));
+        }
+    }
+
+    void waitReady() {
+        if (!readyCallback) return;
+        auto deadline = std::chrono::steady_clock::now() + kReadyTimeout;
+        while (mRunning && !readyCallback()) {
+            if (std::chrono::steady_clock::now() > deadline) {
+                ++mReadyTimeouts;
+                log.warn() << "HeadlessClient engine not ready at " << util::timefmt(util::EngineClock::time(), "%Y-%m-%d %H:%M:%S") << " - rendering anyway";
+                return;
+            }
+            std::this_thread::sleep_for(kReadyPollInterval);
+        }
+    }
+
+    void run() {
+        const size_t nframes = mClientFormat.frameSize;
+        const size_t nsamples = nframes * mClientFormat.channelCount;
+        const auto totalFrames = static_cast<uint64_t>(mDuration * mClientFormat.sampleRate);
+        const auto realStart = std::chrono::steady_clock::now();
+        const auto clockStart = util::EngineClock::time();
+        auto nsAt = [this](uint64_t tFrames) { return static_cast<int64_t>(tFrames * 1e9 / mClientFormat.sampleRate); };
+        time_t nextProgress = clockStart + kProgressInterval;
+        uint64_t frames = 0;
+
+        while (mRunning && frames < totalFrames) {
+            waitReady();
+            {
+                util::RTGuard::Scope realtime;
+                mRenderer->renderCallback(mIn.data(), mOut.data(), nframes);
+            }
+            output(nsamples);
+
+            util::EngineClock::advance(std::chrono::nanoseconds(nsAt(frames + nframes) - nsAt(frames)));
+            frames += nframes;
+            mFramesRendered.store(frames, std::memory_order_relaxed);
+
+            if (mSpeed > 0) {
+                std::this_thread::sleep_until(realStart + std::chrono::nanoseconds(static_cast<int64_t>(nsAt(frames) / mSpeed)));
+            }
+            if (util::EngineClock::time() >= nextProgress) {
+                log.info() << "HeadlessClient at " << util::timefmt(util::EngineClock::time(), "%Y-%m-%d %H:%M:%S") << " (" << (util::EngineClock::time() - clockStart) / 3600 << " h rendered)";
+                nextProgress += kProgressInterval;
+            }
+        }
+
+        auto realSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - realStart).count();
+        auto renderedSeconds = static_cast<double>(frames) / mClientFormat.sampleRate;
+        log.info() << "HeadlessClient rendered " << renderedSeconds << " s in " << realSeconds << " s (" << renderedSeconds / std::max(realSeconds, 1e-3) << "x real time)";
+
+        // background threads keep running on engine time until shutdown
+        util::EngineClock::release();
+        if (mRunning.exchange(false) && finishedCallback) finishedCallback();
+    }
+};
+
+}
+}
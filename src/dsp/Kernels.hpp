@@ -0,0 +1,526 @@
+/*
+ *  Copyright (C) 2024-2025 Christoph Pastl
+ *
+ *  This file is part of Castor.
+ *
+ *  Castor is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Castor is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ *  If you use this program over a network, you must also offer access
+ *  to the source code under the terms of the GNU Lesser General Public License.
+ */
+
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include "audio.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CASTOR_KERNELS_X86 1
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#define CASTOR_KERNELS_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace castor {
+namespace audio {
+namespace kernels {
+
+// Vectorized sample loops used on the render thread. All kernels operate on interleaved samples;
+// "ramp" kernels take one gain per frame of tChannels samples (SIMD paths for mono and stereo).
+// The implementation is selected once at startup from the CPU features (AVX-512 > AVX2 > SSE2 on x86,
+// NEON on arm64) with a scalar fallback for everything else.
+// "Int16" kernels convert between float samples and compact 16-bit storage (full scale 1.0 = 32767).
+
+constexpr float kInt16Scale = 32767.0f;
+
+namespace scalar {
+
+    // dst[i] = src[i] * gain
+    inline void mulGain(sam_t* dst, const sam_t* src, size_t n, float gain) {
+        for (size_t i = 0; i < n; ++i) dst[i] = src[i] * gain;
+    }
+
+    // dst[i] += src[i] * gain
+    inline void mixGain(sam_t* dst, const sam_t* src, size_t n, float gain) {
+        for (size_t i = 0; i < n; ++i) dst[i] += src[i] * gain;
+    }
+
+    // dst[i] = src[i] * env[i / ch]
+    inline void mulRamp(sam_t* dst, const sam_t* src, size_t n, const float* env, size_t ch) {
+        for (size_t i = 0; i < n; ++i) dst[i] = src[i] * env[i / ch];
+    }
+
+    // dst[i] += src[i] * env[i / ch]
+    inline void mixRamp(sam_t* dst, const sam_t* src, size_t n, const float* env, size_t ch) {
+        for (size_t i = 0; i < n; ++i) dst[i] += src[i] * env[i / ch];
+    }
+
+    inline double sumSquares(const sam_t* src, size_t n) {
+        double sum = 0;
+        for (size_t i = 0; i < n; ++i) sum += src[i] * src[i];
+        return sum;
+    }
+
+    // dst[i] = round(clamp(src[i]) * 32767)
+    inline void toInt16(int16_t* dst, const sam_t* src, size_t n) {
+        for (size_t i = 0; i < n; ++i) dst[i] = static_cast<int16_t>(std::lrint(std::fmin(std::fmax(src[i], -1.0f), 1.0f) * kInt16Scale));
+    }
+
+    // dst[i] = src[i] / 32767
+    inline void fromInt16(sam_t* dst, const int16_t* src, size_t n) {
+        for (size_t i = 0; i < n; ++i) dst[i] = src[i] * (1.0f / kInt16Scale);
+    }
+
+    // dst[i] += src[i] / 32767 * env[i / ch]
+    inline void mixRampInt16(sam_t* dst, const int16_t* src, size_t n, const float* env, size_t ch) {
+        for (size_t i = 0; i < n; ++i) dst[i] += src[i] * (1.0f / kInt16Scale) * env[i / ch];
+    }
+}
+
+
+#if CASTOR_KERNELS_X86
+
+namespace sse2 {
+
+    __attribute__((target("sse2")))
+    inline __m128 env(const float* env, size_t ch) {
+        if (ch == 1) return _mm_loadu_ps(env);
+        auto e = _mm_castpd_ps(_mm_load_sd(reinterpret_cast<const double*>(env)));
+        return _mm_unpacklo_ps(e, e); // g0 g0 g1 g1
+    }
+
+    __attribute__((target("sse2")))
+    inline void mulGain(sam_t* dst, const sam_t* src, size_t n, float gain) {
+        auto g = _mm_set1_ps(gain);
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_loadu_ps(src + i), g));
+        scalar::mulGain(dst + i, src + i, n - i, gain);
+    }
+
+    __attribute__((target("sse2")))
+    inline void mixGain(sam_t* dst, const sam_t* src, size_t n, float gain) {
+        auto g = _mm_set1_ps(gain);
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) _mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(dst + i), _mm_mul_ps(_mm_loadu_ps(src + i), g)));
+        scalar::mixGain(dst + i, src + i, n - i, gain);
+    }
+
+    __attribute__((target("sse2")))
+    inline void mulRamp(sam_t* dst, const sam_t* src, size_t n, const float* e, size_t ch) {
+        if (ch > 2) return scalar::mulRamp(dst, src, n, e, ch);
+        const size_t step = 4 / ch;
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4, e += step) _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_loadu_ps(src + i), env(e, ch)));
+        scalar::mulRamp(dst + i, src + i, n - i, e, ch);
+    }
+
+    __attribute__((target("sse2")))
+    inline void mixRamp(sam_t* dst, const sam_t* src, size_t n, const float* e, size_t ch) {
+        if (ch > 2) return scalar::mixRamp(dst, src, n, e, ch);
+        const size_t step = 4 / ch;
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4, e += step) _mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(dst + i), _mm_mul_ps(_mm_loadu_ps(src + i), env(e, ch))));
+        scalar::mixRamp(dst + i, src + i, n - i, e, ch);
+    }
+
+    __attribute__((target("sse2")))
+    inline double sumSquares(const sam_t* src, size_t n) {
+        auto acc = _mm_setzero_pd();
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            auto v = _mm_loadu_ps(src + i);
+            auto sq = _mm_mul_ps(v, v);
+            acc = _mm_add_pd(acc, _mm_cvtps_pd(sq));
+            acc = _mm_add_pd(acc, _mm_cvtps_pd(_mm_movehl_ps(sq, sq)));
+        }
+        double lanes[2];
+        _mm_storeu_pd(lanes, acc);
+        return lanes[0] + lanes[1] + scalar::sumSquares(src + i, n - i);
+    }
+
+    __attribute__((target("sse2")))
+    inline __m128i int16(const sam_t* src) {
+        auto v = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(src), _mm_set1_ps(-1.0f)), _mm_set1_ps(1.0f));
+        return _mm_cvtps_epi32(_mm_mul_ps(v, _mm_set1_ps(kInt16Scale)));
+    }
+
+    __attribute__((target("sse2")))
+    inline __m128 float32(const int16_t* src) {
+        auto v = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(src));
+        auto w = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16); // sign extend
+        return _mm_mul_ps(_mm_cvtepi32_ps(w), _mm_set1_ps(1.0f / kInt16Scale));
+    }
+
+    __attribute__((target("sse2")))
+    inline void toInt16(int16_t* dst, const sam_t* src, size_t n) {
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_packs_epi32(int16(src + i), int16(src + i + 4)));
+        scalar::toInt16(dst + i, src + i, n - i);
+    }
+
+    __attribute__((target("sse2")))
+    inline void fromInt16(sam_t* dst, const int16_t* src, size_t n) {
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) _mm_storeu_ps(dst + i, float32(src + i));
+        scalar::fromInt16(dst + i, src + i, n - i);
+    }
+
+    __attribute__((target("sse2")))
+    inline void mixRampInt16(sam_t* dst, const int16_t* src, size_t n, const float* e, size_t ch) {
+        if (ch > 2) return scalar::mixRampInt16(dst, src, n, e, ch);
+        const size_t step = 4 / ch;
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4, e += step) _mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(dst + i), _mm_mul_ps(float32(src + i), env(e, ch))));
+        scalar::mixRampInt16(dst + i, src + i, n - i, e, ch);
+    }
+}
+
+namespace avx2 {
+
+    __attribute__((target("avx2,fma")))
+    inline __m256 env(const float* env, size_t ch) {
+        if (ch == 1) return _mm256_loadu_ps(env);
+        auto e = _mm256_castps128_ps256(_mm_loadu_ps(env));
+        return _mm256_permutevar8x32_ps(e, _mm256_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3));
+    }
+
+    __attribute__((target("avx2,fma")))
+    inline void mulGain(sam_t* dst, const sam_t* src, size_t n, float gain) {
+        auto g = _mm256_set1_ps(gain);
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) _mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_loadu_ps(src + i), g));
+        sse2::mulGain(dst + i, src + i, n - i, gain);
+    }
+
+    __attribute__((target("avx2,fma")))
+    inline void mixGain(sam_t* dst, const sam_t* src, size_t n, float gain) {
+        auto g = _mm256_set1_ps(gain);
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) _mm256_storeu_ps(dst + i, _mm256_fmadd_ps(_mm256_loadu_ps(src + i), g, _mm256_loadu_ps(dst + i)));
+        sse2::mixGain(dst + i, src + i, n - i, gain);
+    }
+
+    __attribute__((target("avx2,fma")))
+    inline void mulRamp(sam_t* dst, const sam_t* src, size_t n, const float* e, size_t ch) {
+        if (ch > 2) return scalar::mulRamp(dst, src, n, e, ch);
+        const size_t step = 8 / ch;
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8, e += step) _mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_loadu_ps(src + i), env(e, ch)));
+        sse2::mulRamp(dst + i, src + i, n - i, e, ch);
+    }
+
+    __attribute__((target("avx2,fma")))
+    inline void mixRamp(sam_t* dst, const sam_t* src, size_t n, const float* e, size_t ch) {
+        if (ch > 2) return scalar::mixRamp(dst, src, n, e, ch);
+        const size_t step = 8 / ch;
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8, e += step) _mm256_storeu_ps(dst + i, _mm256_fmadd_ps(_mm256_loadu_ps(src + i), env(e, ch), _mm256_loadu_ps(dst + i)));
+        sse2::mixRamp(dst + i, src + i, n - i, e, ch);
+    }
+
+    __attribute__((target("avx2,fma")))
+    inline double sumSquares(const sam_t* src, size_t n) {
+        auto acc = _mm256_setzero_pd();
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            auto v = _mm256_cvtps_pd(_mm_loadu_ps(src + i));
+            acc = _mm256_fmadd_pd(v, v, acc);
+        }
+        double lanes[4];
+        _mm256_storeu_pd(lanes, acc);
+        return lanes[0] + lanes[1] + lanes[2] + lanes[3] + scalar::sumSquares(src + i, n - i);
+    }
+
+    __attribute__((target("avx2,fma")))
+    inline __m256 float32(const int16_t* src) {
+        auto w = _mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src)));
+        return _mm256_mul_ps(_mm256_cvtepi32_ps(w), _mm256_set1_ps(1.0f / kInt16Scale));
+    }
+
+    __attribute__((target("avx2,fma")))
+    inline void toInt16(int16_t* dst, const sam_t* src, size_t n) {
+        auto lo = _mm256_set1_ps(-1.0f);
+        auto hi = _mm256_set1_ps(1.0f);
+        auto scale = _mm256_set1_ps(kInt16Scale);
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            auto w = _mm256_cvtps_epi32(_mm256_mul_ps(_mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(src + i), lo), hi), scale));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_packs_epi32(_mm256_castsi256_si128(w), _mm256_extracti128_si256(w, 1)));
+        }
+        sse2::toInt16(dst + i, src + i, n - i);
+    }
+
+    __attribute__((target("avx2,fma")))
+    inline void fromInt16(sam_t* dst, const int16_t* src, size_t n) {
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) _mm256_storeu_ps(dst + i, float32(src + i));
+        sse2::fromInt16(dst + i, src + i, n - i);
+    }
+
+    __attribute__((target("avx2,fma")))
+    inline void mixRampInt16(sam_t* dst, const int16_t* src, size_t n, const float* e, size_t ch) {
+        if (ch > 2) return scalar::mixRampInt16(dst, src, n, e, ch);
+        const size_t step = 8 / ch;
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8, e += step) _mm256_storeu_ps(dst + i, _mm256_fmadd_ps(float32(src + i), env(e, ch), _mm256_loadu_ps(dst + i)));
+        sse2::mixRampInt16(dst + i, src + i, n - i, e, ch);
+    }
+}
+
+namespace avx512 {
+
+    __attribute__((target("avx512f")))
+    inline __m512 env(const float* env, size_t ch) {
+        if (ch == 1) return _mm512_loadu_ps(env);
+        auto e = _mm512_castps256_ps512(_mm256_loadu_ps(env));
+        return _mm512_permutexvar_ps(_mm512_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7), e);
+    }
+
+    __attribute__((target("avx512f")))
+    inline void mulGain(sam_t* dst, const sam_t* src, size_t n, float gain) {
+        auto g = _mm512_set1_ps(gain);
+        size_t i = 0;
+        for (; i + 16 <= n; i += 16) _mm512_storeu_ps(dst + i, _mm512_mul_ps(_mm512_loadu_ps(src + i), g));
+        avx2::mulGain(dst + i, src + i, n - i, gain);
+    }
+
+    __attribute__((target("avx512f")))
+    inline void mixGain(sam_t* dst, const sam_t* src, size_t n, float gain) {
+        auto g = _mm512_set1_ps(gain);
+        size_t i = 0;
+        for (; i + 16 <= n; i += 16) _mm512_storeu_ps(dst + i, _mm512_fmadd_ps(_mm512_loadu_ps(src + i), g, _mm512_loadu_ps(dst + i)));
+        avx2::mixGain(dst + i, src + i, n - i, gain);
+    }
+
+    __attribute__((target("avx512f")))
+    inline void mulRamp(sam_t* dst, const sam_t* src, size_t n, const float* e, size_t ch) {
+        if (ch > 2) return scalar::mulRamp(dst, src, n, e, ch);
+        const size_t step = 16 / ch;
+        size_t i = 0;
+        for (; i + 16 <= n; i += 16, e += step) _mm512_storeu_ps(dst + i, _mm512_mul_ps(_mm512_loadu_ps(src + i), env(e, ch)));
+        avx2::mulRamp(dst + i, src + i, n - i, e, ch);
+    }
+
+    __attribute__((target("avx512f")))
+    inline void mixRamp(sam_t* dst, const sam_t* src, size_t n, const float* e, size_t ch) {
+        if (ch > 2) return scalar::mixRamp(dst, src, n, e, ch);
+        const size_t step = 16 / ch;
+        size_t i = 0;
+        for (; i + 16 <= n; i += 16, e += step) _mm512_storeu_ps(dst + i, _mm512_fmadd_ps(_mm512_loadu_ps(src + i), env(e, ch), _mm512_loadu_ps(dst + i)));
+        avx2::mixRamp(dst + i, src + i, n - i, e, ch);
+    }
+
+    __attribute__((target("avx512f")))
+    inline double sumSquares(const sam_t* src, size_t n) {
+        auto acc = _mm512_setzero_pd();
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            auto v = _mm512_cvtps_pd(_mm256_loadu_ps(src + i));
+            acc = _mm512_fmadd_pd(v, v, acc);
+        }
+        return _mm512_reduce_add_pd(acc) + avx2::sumSquares(src + i, n - i);
+    }
+
+    __attribute__((target("avx512f")))
+    inline __m512 float32(const int16_t* src) {
+        auto w = _mm512_cvtepi16_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(src)));
+        return _mm512_mul_ps(_mm512_cvtepi32_ps(w), _mm512_set1_ps(1.0f / kInt16Scale));
+    }
+
+    __attribute__((target("avx512f")))
+    inline void toInt16(int16_t* dst, const sam_t* src, size_t n) {
+        auto lo = _mm512_set1_ps(-1.0f);
+        auto hi = _mm512_set1_ps(1.0f);
+        auto scale = _mm512_set1_ps(kInt16Scale);
+        size_t i = 0;
+        for (; i + 16 <= n; i += 16) {
+            auto w = _mm512_cvtps_epi32(_mm512_mul_ps(_mm512_min_ps(_mm512_max_ps(_mm512_loadu_ps(src + i), lo), hi), scale));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm512_cvtsepi32_epi16(w));
+        }
+        avx2::toInt16(dst + i, src + i, n - i);
+    }
+
+    __attribute__((target("avx512f")))
+    inline void fromInt16(sam_t* dst, const int16_t* src, size_t n) {
+        size_t i = 0;
+        for (; i + 16 <= n; i += 16) _mm512_storeu_ps(dst + i, float32(src + i));
+        avx2::fromInt16(dst + i, src + i, n - i);
+    }
+
+    __attribute__((target("avx512f")))
+    inline void mixRampInt16(sam_t* dst, const int16_t* src, size_t n, const float* e, size_t ch) {
+        if (ch > 2) return scalar::mixRampInt16(dst, src, n, e, ch);
+        const size_t step = 16 / ch;
+        size_t i = 0;
+        for (; i + 16 <= n; i += 16, e += step) _mm512_storeu_ps(dst + i, _mm512_fmadd_ps(float32(src + i), env(e, ch), _mm512_loadu_ps(dst + i)));
+        avx2::mixRampInt16(dst + i, src + i, n - i, e, ch);
+    }
+}
+
+#elif CASTOR_KERNELS_NEON
+
+namespace neon {
+
+    inline float32x4_t env(const float* env, size_t ch) {
+        if (ch == 1) return vld1q_f32(env);
+        auto e = vld1_f32(env);
+        auto z = vzip_f32(e, e); // g0 g0 g1 g1
+        return vcombine_f32(z.val[0], z.val[1]);
+    }
+
+    inline void mulGain(sam_t* dst, const sam_t* src, size_t n, float gain) {
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) vst1q_f32(dst + i, vmulq_n_f32(vld1q_f32(src + i), gain));
+        scalar::mulGain(dst + i, src + i, n - i, gain);
+    }
+
+    inline void mixGain(sam_t* dst, const sam_t* src, size_t n, float gain) {
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) vst1q_f32(dst + i, vfmaq_n_f32(vld1q_f32(dst + i), vld1q_f32(src + i), gain));
+        scalar::mixGain(dst + i, src + i, n - i, gain);
+    }
+
+    inline void mulRamp(sam_t* dst, const sam_t* src, size_t n, const float* e, size_t ch) {
+        if (ch > 2) return scalar::mulRamp(dst, src, n, e, ch);
+        const size_t step = 4 / ch;
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4, e += step) vst1q_f32(dst + i, vmulq_f32(vld1q_f32(src + i), env(e, ch)));
+        scalar::mulRamp(dst + i, src + i, n - i, e, ch);
+    }
+
+    inline void mixRamp(sam_t* dst, const sam_t* src, size_t n, const float* e, size_t ch) {
+        if (ch > 2) return scalar::mixRamp(dst, src, n, e, ch);
+        const size_t step = 4 / ch;
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4, e += step) vst1q_f32(dst + i, vfmaq_f32(vld1q_f32(dst + i), vld1q_f32(src + i), env(e, ch)));
+        scalar::mixRamp(dst + i, src + i, n - i, e, ch);
+    }
+
+    inline double sumSquares(const sam_t* src, size_t n) {
+        auto acc = vdupq_n_f64(0);
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            auto v = vld1q_f32(src + i);
+            auto lo = vcvt_f64_f32(vget_low_f32(v));
+            auto hi = vcvt_high_f64_f32(v);
+            acc = vfmaq_f64(vfmaq_f64(acc, lo, lo), hi, hi);
+        }
+        return vaddvq_f64(acc) + scalar::sumSquares(src + i, n - i);
+    }
+
+    inline float32x4_t float32(const int16_t* src) {
+        return vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vld1_s16(src))), 1.0f / kInt16Scale);
+    }
+
+    inline void toInt16(int16_t* dst, const sam_t* src, size_t n) {
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) vst1_s16(dst + i, vqmovn_s32(vcvtnq_s32_f32(vmulq_n_f32(vld1q_f32(src + i), kInt16Scale)))); // saturating
+        scalar::toInt16(dst + i, src + i, n - i);
+    }
+
+    inline void fromInt16(sam_t* dst, const int16_t* src, size_t n) {
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) vst1q_f32(dst + i, float32(src + i));
+        scalar::fromInt16(dst + i, src + i, n - i);
+    }
+
+    inline void mixRampInt16(sam_t* dst, const int16_t* src, size_t n, const float* e, size_t ch) {
+        if (ch > 2) return scalar::mixRampInt16(dst, src, n, e, ch);
+        const size_t step = 4 / ch;
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4, e += step) vst1q_f32(dst + i, vfmaq_f32(vld1q_f32(dst + i), float32(src + i), env(e, ch)));
+        scalar::mixRampInt16(dst + i, src + i, n - i, e, ch);
+    }
+}
+
+#endif
+
+
+struct Dispatch {
+    const char* isa;
+    void (*mulGain)(sam_t*, const sam_t*, size_t, float);
+    void (*mixGain)(sam_t*, const sam_t*, size_t, float);
+    void (*mulRamp)(sam_t*, const sam_t*, size_t, const float*, size_t);
+    void (*mixRamp)(sam_t*, const sam_t*, size_t, const float*, size_t);
+    double (*sumSquares)(const sam_t*, size_t);
+    void (*toInt16)(int16_t*, const sam_t*, size_t);
+    void (*fromInt16)(sam_t*, const int16_t*, size_t);
+    void (*mixRampInt16)(sam_t*, const int16_t*, size_t, const float*, size_t);
+};
+
+#define CASTOR_KERNELS_DISPATCH(ns) Dispatch{ #ns, &ns::mulGain, &ns::mixGain, &ns::mulRamp, &ns::mixRamp, &ns::sumSquares, &ns::toInt16, &ns::fromInt16, &ns::mixRampInt16 }
+
+inline Dispatch selectDispatch() {
+    #if CASTOR_KERNELS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) return CASTOR_KERNELS_DISPATCH(avx512);
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) return CASTOR_KERNELS_DISPATCH(avx2);
+    if (__builtin_cpu_supports("sse2")) return CASTOR_KERNELS_DISPATCH(sse2);
+    #elif CASTOR_KERNELS_NEON
+    return CASTOR_KERNELS_DISPATCH(neon);
+    #endif
+    return CASTOR_KERNELS_DISPATCH(scalar);
+}
+
+#undef CASTOR_KERNELS_DISPATCH
+
+inline const Dispatch kDispatch = selectDispatch();
+
+
+inline const char* isa() { return kDispatch.isa; }
+
+// copy + gain (in place if dst == src)
+inline void mulGain(sam_t* dst, const sam_t* src, size_t n, float gain) { kDispatch.mulGain(dst, src, n, gain); }
+
+// mix-accumulate with a constant gain
+inline void mixGain(sam_t* dst, const sam_t* src, size_t n, float gain) { kDispatch.mixGain(dst, src, n, gain); }
+
+// copy + per-frame gain ramp (in place if dst == src)
+inline void mulRamp(sam_t* dst, const sam_t* src, size_t n, const float* env, size_t ch) { kDispatch.mulRamp(dst, src, n, env, ch); }
+
+// mix-accumulate with a per-frame gain ramp
+inline void mixRamp(sam_t* dst, const sam_t* src, size_t n, const float* env, size_t ch) { kDispatch.mixRamp(dst, src, n, env, ch); }
+
+// float to 16-bit samples, clipped to full scale
+inline void toInt16(int16_t* dst, const sam_t* src, size_t n) { kDispatch.toInt16(dst, src, n); }
+
+// 16-bit to float samples
+inline void fromInt16(sam_t* dst, const int16_t* src, size_t n) { kDispatch.fromInt16(dst, src, n); }
+
+// mix-accumulate 16-bit samples with a per-frame gain ramp
+inline void mixRampInt16(sam_t* dst, const int16_t* src, size_t n, const float* env, size_t ch) { kDispatch.mixRampInt16(dst, src, n, env, ch); }
+
+inline float rms(const sam_t* src, size_t n) {
+    if (n == 0) return 0;
+    auto mean = kDispatch.sumSquares(src, n) / n;
+    return mean > 0 ? static_cast<float>(std::sqrt(mean)) : 0;
+}
+
+// flushes denormals to zero on the calling thread (FTZ/DAZ), so decaying fades don't hit slow paths
+inline void flushDenormals() {
+    #if CASTOR_KERNELS_X86
+    _mm_setcsr(_mm_getcsr() | 0x8040);
+    #elif CASTOR_KERNELS_NEON
+    uint64_t fpcr;
+    __asm__ __volatile__("mrs %0, fpcr" : "=r"(fpcr));
+    __asm__ __volatile__("msr fpcr, %0" :: "r"(fpcr | (1 << 24)));
+    #endif
+}
+
+}
+}
+}
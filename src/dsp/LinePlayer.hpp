@@ -42,6 +42,11 @@ public:
         memcpy(tData, mBufferPtr, tLen * sizeof(T));
         return tLen;
     }
+
+    size_t mix(T* tData, size_t tLen, const float* tGain, size_t tChannels) override {
+        kernels::mixRamp(tData, mBufferPtr, tLen, tGain, tChannels);
+        return tLen;
+    }
 };
     
 class LinePlayer : public Player {
@@ -64,11 +69,11 @@ public:
 
     void load(const std::string& tURL, double seek = 0) override {}
 
-    size_t process(const sam_t* tInBuffer, sam_t* tOutBuffer, size_t tFrameCount) override {
+    size_t mix(const sam_t* tInBuffer, sam_t* tOutBuffer, size_t tFrameCount, float tGain) override {
         auto sampleCount = tFrameCount * clientFormat.channelCount;
         mLineBuffer.write(tInBuffer, sampleCount);
 
-        return Player::process(tInBuffer, tOutBuffer, tFrameCount);
+        return Player::mix(tInBuffer, tOutBuffer, tFrameCount, tGain);
     }
 };
 }
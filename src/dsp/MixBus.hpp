@@ -0,0 +1,114 @@
+/*
+ *  Copyright (C) 2024-2025 Christoph Pastl
+ *
+ *  This file is part of Castor.
+ *
+ *  Castor is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Castor is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ *  If you use this program over a network, you must also offer access
+ *  to the source code under the terms of the GNU Lesser General Public License.
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include "AudioProcessor.hpp"
+#include "../util/Log.hpp"
+
+namespace castor {
+namespace audio {
+
+// Sums all active voices into the output buffer in place.
+// Program players are passed per render cycle (RCU snapshot), auxiliary voices like the fallback
+// are registered once before the stream starts. When a program player starts its fade-in, all
+// other playing program players start fading out at the same sample, so crossfades line up exactly.
+class MixBus {
+public:
+    static constexpr size_t kMaxVoices = 8;
+
+private:
+    struct Voice {
+        Input* input = nullptr;
+        std::atomic<float> gain = 1.0f;
+    };
+
+    std::array<Voice, kMaxVoices> mVoices;
+    std::atomic<size_t> mVoiceCount = 0;
+    std::atomic<size_t> mActiveVoices = 0;
+
+public:
+
+    // not realtime safe, call before the render thread starts
+    size_t addVoice(Input& tInput, float tGain = 1.0f) {
+        auto idx = mVoiceCount.load();
+        if (idx == kMaxVoices) throw std::runtime_error("MixBus voice limit reached");
+        mVoices[idx].input = &tInput;
+        mVoices[idx].gain = tGain;
+        mVoiceCount.store(idx + 1, std::memory_order_release);
+        return idx;
+    }
+
+    void setVoiceGain(size_t tIdx, float tGain) {
+        if (tIdx < kMaxVoices) mVoices[tIdx].gain = tGain;
+    }
+
+    size_t activeVoices() const {
+        return mActiveVoices.load(std::memory_order_relaxed);
+    }
+
+
+    // realtime thread
+
+    // tExternal is a player rendered elsewhere (render-ahead), it is faded out like the others but not mixed here
+    template <typename Range>
+    size_t mixProgram(const Range& tPlayers, const sam_t* in, sam_t* out, size_t nframes, float gain, const Player* tExternal = nullptr) {
+        bool fadeInPending = false;
+        for (auto player : tPlayers) {
+            if (player && player->isPlaying() && player->isFadeInPending()) {
+                fadeInPending = true;
+                break;
+            }
+        }
+
+        size_t active = 0;
+        for (auto player : tPlayers) {
+            if (!player || !player->isPlaying()) continue;
+            if (fadeInPending && !player->isFadeInPending()) player->fadeOut();
+            if (player == tExternal) {
+                ++active;
+                continue;
+            }
+            if (player->mix(in, out, nframes, gain) > 0) ++active;
+        }
+        mActiveVoices.store(active, std::memory_order_relaxed);
+        return active;
+    }
+
+    size_t mixVoices(const sam_t* in, sam_t* out, size_t nframes, float masterGain = 1.0f) {
+        auto count = mVoiceCount.load(std::memory_order_acquire);
+        size_t active = 0;
+        for (size_t i = 0; i < count; ++i) {
+            auto& voice = mVoices[i];
+            auto gain = voice.gain.load(std::memory_order_relaxed) * masterGain;
+            if (gain == 0.0f) continue;
+            if (voice.input->mix(in, out, nframes, gain) > 0) ++active;
+        }
+        mActiveVoices.fetch_add(active, std::memory_order_relaxed);
+        return active;
+    }
+};
+
+}
+}
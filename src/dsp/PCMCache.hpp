@@ -0,0 +1,312 @@
+/*
+ *  Copyright (C) 2024-2025 Christoph Pastl
+ *
+ *  This file is part of Castor.
+ *
+ *  Castor is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Castor is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ *  If you use this program over a network, you must also offer access
+ *  to the source code under the terms of the GNU Lesser General Public License.
+ */
+
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "audio.hpp"
+#include "../util/Log.hpp"
+
+namespace castor {
+namespace audio {
+
+// On-disk cache of files decoded to the client format, so repeated loads (also across restarts) map
+// the samples instead of decoding and resampling them again.
+// Entries are keyed by path, size and modification time of the source and by the client format;
+// the least recently used entries are evicted once the cache exceeds its size budget.
+class PCMCache {
+    static constexpr char kMagic[8] = {'C','S','T','R','P','C','M','1'};
+    static constexpr uint32_t kVersion = 1;
+    static constexpr const char* kExtension = ".pcm";
+    static constexpr size_t kChunkSize = 1 << 16;
+
+    // precedes the raw samples, sized to keep them aligned
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t sampleRate;
+        uint32_t channelCount;
+        uint32_t sampleSize;
+        uint64_t sampleCount;
+        uint64_t sourceSize;
+        int64_t sourceTime;
+        uint8_t reserved[16];
+    };
+    static_assert(sizeof(Header) == 64);
+
+public:
+    // identifies a source file as it was when it was opened
+    struct Key {
+        std::string path;
+        uint64_t size;
+        int64_t time;
+    };
+
+    // read-only mapping of a cached file, unmapped when the last reference is dropped
+    class Entry {
+        void* mAddr;
+        size_t mBytes;
+        size_t mSampleCount;
+
+    public:
+        Entry(void* tAddr, size_t tBytes, size_t tSampleCount) :
+            mAddr(tAddr),
+            mBytes(tBytes),
+            mSampleCount(tSampleCount)
+        {}
+
+        ~Entry() {
+            munmap(mAddr, mBytes);
+        }
+
+        Entry(const Entry&) = delete;
+        Entry& operator=(const Entry&) = delete;
+
+        const sam_t* data() const {
+            return reinterpret_cast<const sam_t*>(static_cast<const char*>(mAddr) + sizeof(Header));
+        }
+
+        size_t sampleCount() const { return mSampleCount; }
+        size_t bytes() const { return mBytes; }
+    };
+
+private:
+    const AudioStreamFormat& mClientFormat;
+    const std::filesystem::path mPath;
+    const size_t mBudget;
+    bool mEnabled = false;
+    std::mutex mEvictMutex;
+    std::atomic<size_t> mTmpCounter = 0;
+
+public:
+    // empty tPath disables the cache, tBudget in bytes
+    PCMCache(const AudioStreamFormat& tClientFormat, const std::string& tPath, size_t tBudget) :
+        mClientFormat(tClientFormat),
+        mPath(tPath),
+        mBudget(tBudget)
+    {
+        if (tPath.empty() || tBudget == 0) return;
+        std::error_code ec;
+        std::filesystem::create_directories(mPath, ec);
+        if (ec) {
+            log.warn() << "PCMCache failed to create " << tPath << ": " << ec.message() << " - caching disabled";
+            return;
+        }
+        // leftovers of interrupted stores
+        for (const auto& file : std::filesystem::directory_iterator(mPath, ec)) {
+            if (file.path().extension() == ".tmp") std::filesystem::remove(file.path(), ec);
+        }
+        mEnabled = true;
+        log.info() << "PCMCache using " << tPath << " with " << (mBudget >> 20) << " MiB budget";
+    }
+
+    bool enabled() const {
+        return mEnabled;
+    }
+
+    // local files only, nothing for streams or missing files
+    std::optional<Key> key(const std::string& tURL) const {
+        if (!mEnabled) return std::nullopt;
+        std::error_code ec;
+        if (!std::filesystem::is_regular_file(tURL, ec)) return std::nullopt;
+        auto size = std::filesystem::file_size(tURL, ec);
+        if (ec) return std::nullopt;
+        auto time = std::filesystem::last_write_time(tURL, ec);
+        if (ec) return std::nullopt;
+        return Key{tURL, static_cast<uint64_t>(size), static_cast<int64_t>(time.time_since_epoch().count())};
+    }
+
+    // maps the entry for tKey, nullptr on a miss; pages are read in by the buffer ahead of its read head
+    // (see FileBuffer::prefetch), populating the whole file would read it on every hit
+    std::shared_ptr<const Entry> find(const Key& tKey) const {
+        auto path = entryPath(tKey);
+        auto fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) return nullptr;
+
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(Header))) {
+            close(fd);
+            return nullptr;
+        }
+
+        auto bytes = static_cast<size_t>(st.st_size);
+        auto addr = mmap(nullptr, bytes, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (addr == MAP_FAILED) {
+            log.warn() << "PCMCache failed to map " << path.string() << ": " << strerror(errno);
+            return nullptr;
+        }
+
+        auto header = static_cast<const Header*>(addr);
+        if (!matches(*header, tKey) || sizeof(Header) + header->sampleCount * sizeof(sam_t) != bytes) {
+            munmap(addr, bytes);
+            log.warn() << "PCMCache dropping stale entry " << path.string();
+            std::error_code ec;
+            std::filesystem::remove(path, ec);
+            return nullptr;
+        }
+        auto entry = std::make_shared<const Entry>(addr, bytes, header->sampleCount);
+
+        // last use orders the eviction
+        std::error_code ec;
+        std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), ec);
+
+        log.debug() << "PCMCache hit " << tKey.path << " (" << (bytes >> 20) << " MiB)";
+        return entry;
+    }
+
+    // writes a completely decoded file (taken from tKey before decoding) and evicts down to the budget
+    bool store(const Key& tKey, const sam_t* tData, size_t tSampleCount) {
+        return store(tKey, tSampleCount, [tData](sam_t* data, size_t pos, size_t len) { memcpy(data, tData + pos, len * sizeof(sam_t)); });
+    }
+
+    // as above, with samples provided in chunks by tFill(data, pos, len) (e.g. converted from compact storage)
+    bool store(const Key& tKey, size_t tSampleCount, const std::function<void(sam_t*, size_t, size_t)>& tFill) {
+        if (!mEnabled || tSampleCount == 0) return false;
+        auto bytes = sizeof(Header) + tSampleCount * sizeof(sam_t);
+        if (bytes > mBudget) return false;
+
+        auto path = entryPath(tKey);
+        std::error_code ec;
+        if (std::filesystem::exists(path, ec)) return true;
+
+        Header header = {};
+        memcpy(header.magic, kMagic, sizeof(kMagic));
+        header.version = kVersion;
+        header.sampleRate = static_cast<uint32_t>(mClientFormat.sampleRate);
+        header.channelCount = static_cast<uint32_t>(mClientFormat.channelCount);
+        header.sampleSize = sizeof(sam_t);
+        header.sampleCount = tSampleCount;
+        header.sourceSize = tKey.size;
+        header.sourceTime = tKey.time;
+
+        // written aside and renamed, so readers never see a partial entry
+        auto tmpPath = path;
+        tmpPath += "." + std::to_string(getpid()) + "-" + std::to_string(mTmpCounter++) + ".tmp";
+        {
+            std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+            file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            std::vector<sam_t> chunk(std::min(tSampleCount, kChunkSize));
+            for (size_t pos = 0; pos < tSampleCount && file; pos += chunk.size()) {
+                auto len = std::min(chunk.size(), tSampleCount - pos);
+                tFill(chunk.data(), pos, len);
+                file.write(reinterpret_cast<const char*>(chunk.data()), len * sizeof(sam_t));
+            }
+            file.close();
+            if (!file) {
+                log.warn() << "PCMCache failed to write " << tmpPath.string();
+                std::filesystem::remove(tmpPath, ec);
+                return false;
+            }
+        }
+        std::filesystem::rename(tmpPath, path, ec);
+        if (ec) {
+            log.warn() << "PCMCache failed to store " << path.string() << ": " << ec.message();
+            std::filesystem::remove(tmpPath, ec);
+            return false;
+        }
+        log.debug() << "PCMCache stored " << tKey.path << " (" << (bytes >> 20) << " MiB)";
+
+        evict();
+        return true;
+    }
+
+private:
+    std::filesystem::path entryPath(const Key& tKey) const {
+        // FNV-1a, stable across builds and restarts
+        uint64_t hash = 14695981039346656037ull;
+        auto mix = [&](const void* tData, size_t tLen) {
+            auto bytes = static_cast<const uint8_t*>(tData);
+            for (size_t i = 0; i < tLen; ++i) hash = (hash ^ bytes[i]) * 1099511628211ull;
+        };
+        uint64_t format[] = {tKey.size, static_cast<uint64_t>(tKey.time), static_cast<uint64_t>(mClientFormat.sampleRate), static_cast<uint64_t>(mClientFormat.channelCount)};
+        mix(tKey.path.data(), tKey.path.size());
+        mix(format, sizeof(format));
+
+        char name[17];
+        snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(hash));
+        return mPath / (std::string(name) + kExtension);
+    }
+
+    bool matches(const Header& tHeader, const Key& tKey) const {
+        return memcmp(tHeader.magic, kMagic, sizeof(kMagic)) == 0
+            && tHeader.version == kVersion
+            && tHeader.sampleRate == static_cast<uint32_t>(mClientFormat.sampleRate)
+            && tHeader.channelCount == static_cast<uint32_t>(mClientFormat.channelCount)
+            && tHeader.sampleSize == sizeof(sam_t)
+            && tHeader.sourceSize == tKey.size
+            && tHeader.sourceTime == tKey.time;
+    }
+
+    // removes the least recently used entries until the cache fits its budget
+    // (mapped entries stay readable until they are unmapped)
+    void evict() {
+        std::lock_guard<std::mutex> lock(mEvictMutex);
+        struct File {
+            std::filesystem::path path;
+            size_t size;
+            std::filesystem::file_time_type time;
+        };
+        std::vector<File> files;
+        size_t total = 0;
+        std::error_code ec;
+        for (const auto& file : std::filesystem::directory_iterator(mPath, ec)) {
+            if (file.path().extension() != kExtension) continue;
+            std::error_code fec;
+            auto size = file.file_size(fec);
+            auto time = file.last_write_time(fec);
+            if (fec) continue;
+            files.push_back({file.path(), size, time});
+            total += size;
+        }
+        if (total <= mBudget) return;
+
+        std::sort(files.begin(), files.end(), [](const auto& a, const auto& b) { return a.time < b.time; });
+        for (const auto& file : files) {
+            if (total <= mBudget) break;
+            if (std::filesystem::remove(file.path, ec)) {
+                total -= file.size;
+                log.debug() << "PCMCache evicted " << file.path.filename().string();
+            }
+        }
+    }
+};
+
+}
+}
@@ -0,0 +1,236 @@
+/*
+ *  Copyright (C) 2024-2025 Christoph Pastl
+ *
+ *  This file is part of Castor.
+ *
+ *  Castor is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Castor is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ *  If you use this program over a network, you must also offer access
+ *  to the source code under the terms of the GNU Lesser General Public License.
+ */
+
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "AudioProcessor.hpp"
+#include "CodecReader.hpp"
+#include "FilePlayer.hpp"
+#include "../api/API.hpp"
+#include "../util/EngineClock.hpp"
+#include "../util/Log.hpp"
+
+namespace castor {
+namespace audio {
+
+// Plays a whole playlist block (the tracks of its play item) from one streaming window.
+// A single decode thread reads the tracks one after another into the window, so each track follows the previous
+// one at the next sample instead of on a wall-clock second. The start of a track is reported (startCallback)
+// once the read head reaches the sample it was written at.
+class PlaylistPlayer : public Player {
+    static constexpr auto kAnnounceInterval = std::chrono::milliseconds(100); // polling once all tracks are decoded
+
+    // first sample of a track in the window
+    struct Mark {
+        size_t position;
+        std::shared_ptr<PlayItem> track;
+    };
+
+    // passes decoded samples on to the window up to the end of the block, reporting the tracks reached meanwhile
+    class TrackWriter : public SourceBuffer<sam_t> {
+        PlaylistPlayer& mPlayer;
+
+    public:
+        TrackWriter(PlaylistPlayer& tPlayer) :
+            mPlayer(tPlayer)
+        {}
+
+        size_t write(const sam_t* tData, size_t tLen) override {
+            mPlayer.announce();
+            auto& buffer = mPlayer.mStreamBuffer;
+            auto len = std::min(tLen, buffer.capacity() - std::min(buffer.writePosition(), buffer.capacity()));
+            return len > 0 ? buffer.write(tData, len) : 0;
+        }
+
+        size_t read(sam_t* tData, size_t tLen) override { return 0; }
+        size_t mix(sam_t* tData, size_t tLen, const float* tGain, size_t tChannels) override { return 0; }
+    };
+
+    FileStreamBuffer<sam_t> mStreamBuffer;
+    std::thread mDecodeWorker;
+    std::mutex mReaderMutex;
+    std::unique_ptr<CodecReader> mReader = nullptr; // of the track being decoded
+    std::atomic<bool> mCancelled = false;
+    std::mutex mMarksMutex;
+    std::deque<Mark> mMarks; // tracks not reported yet
+    std::atomic<bool> mStarted = false;
+
+public:
+    // decodes tLookahead seconds ahead of playback
+    PlaylistPlayer(const AudioStreamFormat& tClientFormat, const std::string tName = "", time_t tPreloadTime = 0, float tFadeInTime = 0, float tFadeOutTime = 0, double tLookahead = 30) :
+        Player(tClientFormat, tName, tPreloadTime, tFadeInTime, tFadeOutTime),
+        mStreamBuffer(static_cast<size_t>(tLookahead * tClientFormat.sampleRate) * tClientFormat.channelCount)
+    {
+        category = "LIST";
+        mBuffer = &mStreamBuffer;
+    }
+
+    ~PlaylistPlayer() {
+        log.debug() << "PlaylistPlayer " << name << " dealloc...";
+        if (state != IDLE) stop();
+        joinDecoder();
+        log.debug() << "PlaylistPlayer " << name << " dealloced";
+    }
+
+    bool canRenderAhead() const override {
+        return true;
+    }
+
+    bool isStarved() const override {
+        return isPlaying() && !mStreamBuffer.isComplete() && mStreamBuffer.available() < mStreamBuffer.window() / 2;
+    }
+
+    void load(const std::string& tURL, double seek = 0) override {
+        log.info() << "PlaylistPlayer load " << tURL << " position " << seek;
+        if (!playItem || playItem->tracks.empty()) throw std::runtime_error("PlaylistPlayer has no tracks for " + tURL);
+        joinDecoder();
+
+        auto tracks = playItem->tracks;
+        auto position = playItem->start + static_cast<time_t>(seek);
+        size_t index = 0;
+        while (index < tracks.size() && tracks[index]->end <= position) ++index;
+        if (index == tracks.size()) throw std::runtime_error("PlaylistPlayer has no tracks left in " + tURL);
+
+        // the first track is opened here, so a block that can't start fails to load
+        auto offset = static_cast<double>(std::max(position - tracks[index]->start, time_t(0)));
+        auto reader = std::make_unique<CodecReader>(clientFormat, tracks[index]->uri, offset);
+
+        auto samplesPerSecond = static_cast<size_t>(clientFormat.sampleRate) * clientFormat.channelCount;
+        mStreamBuffer.resize(static_cast<size_t>(std::max(playItem->end - position, time_t(0))) * samplesPerSecond);
+        {
+            std::lock_guard<std::mutex> lock(mMarksMutex);
+            mMarks.clear();
+        }
+        mCancelled = false;
+        mStarted = false;
+        mDecodeWorker = std::thread(&PlaylistPlayer::decode, this, std::move(tracks), index, std::move(reader));
+        log.debug() << "PlaylistPlayer streaming " << playItem->tracks.size() - index << " tracks of " << tURL << " with " << mStreamBuffer.memorySizeMiB() << " MiB lookahead";
+    }
+
+    void announceStart() override {
+        mStarted = true;
+        announce();
+    }
+
+    void stop() override {
+        log.debug() << "PlaylistPlayer " << name << " stop...";
+        Player::stop();
+        cancelDecoder();
+        log.debug() << "PlaylistPlayer " << name << " stopped";
+    }
+
+private:
+    // decode thread: the tracks from tIndex on, back to back
+    void decode(std::vector<std::shared_ptr<PlayItem>> tTracks, size_t tIndex, std::unique_ptr<CodecReader> tReader) {
+        TrackWriter writer(*this);
+        for (auto i = tIndex; i < tTracks.size() && !mCancelled; ++i) {
+            if (mStreamBuffer.writePosition() >= mStreamBuffer.capacity()) break; // block ends here
+            const auto& track = tTracks[i];
+            auto reader = std::move(tReader);
+            try {
+                if (!reader) reader = std::make_unique<CodecReader>(clientFormat, track->uri);
+            }
+            catch (const std::exception& e) {
+                log.error() << "PlaylistPlayer failed to open '" << track->uri << "': " << e.what();
+                continue;
+            }
+            track->metadata = reader->metadata();
+            {
+                std::lock_guard<std::mutex> lock(mMarksMutex);
+                mMarks.push_back({mStreamBuffer.writePosition(), track});
+            }
+            {
+                std::lock_guard<std::mutex> lock(mReaderMutex);
+                if (mCancelled) break;
+                mReader = std::move(reader);
+            }
+            auto complete = false;
+            try {
+                complete = mReader->read(writer);
+            }
+            catch (const std::exception& e) {
+                log.error() << "PlaylistPlayer failed to decode '" << track->uri << "': " << e.what();
+            }
+            {
+                std::lock_guard<std::mutex> lock(mReaderMutex);
+                retire(mReader);
+            }
+            if (!complete && !mCancelled && mStreamBuffer.writePosition() < mStreamBuffer.capacity()) {
+                log.warn() << "PlaylistPlayer decoding '" << track->uri << "' failed, continuing with the next track";
+            }
+        }
+        mStreamBuffer.finish();
+
+        // tracks starting within the last window are reported while it plays out
+        while (!mCancelled) {
+            {
+                std::lock_guard<std::mutex> lock(mMarksMutex);
+                if (mMarks.empty()) break;
+            }
+            announce();
+            util::EngineClock::sleepFor(kAnnounceInterval);
+        }
+    }
+
+    // reports the tracks the read head has reached (once the block has started)
+    void announce() {
+        if (!mStarted) return;
+        auto position = mStreamBuffer.readPosition();
+        std::vector<std::shared_ptr<PlayItem>> started;
+        {
+            std::lock_guard<std::mutex> lock(mMarksMutex);
+            while (!mMarks.empty() && mMarks.front().position <= position) {
+                started.push_back(std::move(mMarks.front().track));
+                mMarks.pop_front();
+            }
+        }
+        for (const auto& track : started) {
+            log.info(Log::Magenta) << "PLAY " << name << " track " << track->uri;
+            if (startCallback) startCallback(track);
+        }
+    }
+
+    void cancelDecoder() {
+        mCancelled = true;
+        mStreamBuffer.cancel();
+        std::lock_guard<std::mutex> lock(mReaderMutex);
+        if (mReader) mReader->cancel();
+    }
+
+    void joinDecoder() {
+        if (!mDecodeWorker.joinable()) return;
+        cancelDecoder();
+        mDecodeWorker.join();
+    }
+};
+
+}
+}
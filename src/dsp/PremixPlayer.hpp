@@ -28,6 +28,7 @@
 #include <vector>
 #include "AudioProcessor.hpp"
 #include "CodecReader.hpp"
+#include "FilePlayer.hpp"
 #include "../util/Log.hpp"
 #include "../util/util.hpp"
 
@@ -46,29 +47,30 @@ class PremixBuffer : public FileBuffer<T> {
     std::vector<T> mFadeOutCurve;
 
 public:
+    using FileBuffer<T>::FileBuffer;
 
+    // bounded by the capacity (unlike a FileBuffer), tracks are rejected when they don't fit
     size_t write(const T* tData, size_t tLen) override {
         auto writable = std::min(tLen, this->mCapacity - this->mWritePos);
         if (writable == 0) return 0;
-        if (this->mWritePos >= mFadeInPos && this->mWritePos <= mFadeInPos + mFadeInLen*2 - tLen) {
-            for (auto i = 0; i < writable / 2; ++i) {
-                assert(mFadeInCurveIdx+1 < mFadeInCurve.size()-1);
-                auto iL = i * 2;
-                auto iR = iL + 1;
-                auto ch1L = this->mBuffer[this->mWritePos + iL];
-                auto ch1R = this->mBuffer[this->mWritePos + iR];
-                auto ch2L = tData[iL] * mFadeInCurve[mFadeInCurveIdx];
-                auto ch2R = tData[iR] * mFadeInCurve[mFadeInCurveIdx++];
-                this->mBuffer[this->mWritePos + iL] = ch1L + ch2L;
-                this->mBuffer[this->mWritePos + iR] = ch1R + ch2R;
-            }
+        size_t pos = this->mWritePos;
+        if (pos >= mFadeInPos && pos <= mFadeInPos + mFadeInLen*2 - tLen) {
+            assert(mFadeInCurveIdx + writable / 2 <= mFadeInCurve.size());
+            auto curve = &mFadeInCurve[mFadeInCurveIdx];
+            this->transform(pos, writable, [&](T* data, size_t offset, size_t len) { kernels::mixRamp(data, tData + offset, len, curve + offset / 2, 2); });
+            mFadeInCurveIdx += writable / 2;
         } else {
-            memcpy(&this->mBuffer[this->mWritePos], tData, writable * sizeof(T));
+            this->store(pos, tData, writable);
         }
-        this->mWritePos += writable;
+        this->mWritePos = pos + writable;
         return writable;
     }
 
+    // fades and the capacity bound are applied per block in write()
+    std::span<T> writeSpan(size_t tLen) override {
+        return {};
+    }
+
     void setFadeZone(size_t tFadeOutPos, size_t tFadeOutLen, size_t tFadeInPos, size_t tFadeInLen) {
         mFadeOutPos = tFadeOutPos;
         mFadeOutLen = tFadeOutLen;
@@ -98,23 +100,23 @@ public:
         mFadeInCurveIdx = 0;
         mFadeOutCurveIdx = 0;
 
-        this->mWritePos = mFadeInPos;;
+        // the fade-in is mixed onto what is there, chunks past the written samples are not initialized
+        size_t written = this->mWritePos;
+        auto fadeInEnd = mFadeInPos + mFadeInLen * 2;
+        if (fadeInEnd > written) {
+            this->transform(written, fadeInEnd - written, [](T* data, size_t, size_t len) { memset(data, 0, len * sizeof(T)); });
+        }
+
+        this->mWritePos = mFadeInPos;
     }
 
     void renderFadeOut() {
-        auto start = this->mWritePos - mFadeOutLen * 2;
-        for (auto i = 0; i < mFadeOutLen; ++i) {
-            auto iL = i * 2;
-            auto iR = iL + 1;
-            this->mBuffer[start + iL] *= mFadeOutCurve[i];
-            this->mBuffer[start + iR] *= mFadeOutCurve[i];
-        }
+        auto curve = mFadeOutCurve.data();
+        this->transform(this->mWritePos - mFadeOutLen * 2, mFadeOutLen * 2, [&](T* data, size_t offset, size_t len) { kernels::mulRamp(data, data, len, curve + offset / 2, 2); });
     }
 
     void reset() {
-        this->mWritePos = 0;
-        this->mReadPos = 0;
-        memset(this->mBuffer.data(), 0, mFadeInLen * 2 * sizeof(T));
+        this->rewind();
     }
 };
 
@@ -140,9 +142,11 @@ class PremixPlayer : public Player {
     double mPrevTrackDuration = 0;
 
 public:
-    PremixPlayer(const AudioStreamFormat& tClientFormat, const std::string tName = "", time_t tPreloadTime = 0, float tFadeInTime = 0, float tFadeOutTime = 0, float tCrossFadeTime = 1) :
+    // tCompact keeps the premix in 16 bit
+    PremixPlayer(const AudioStreamFormat& tClientFormat, const std::string tName = "", time_t tPreloadTime = 0, float tFadeInTime = 0, float tFadeOutTime = 0, float tCrossFadeTime = 1, bool tCompact = false, std::shared_ptr<util::ChunkPool> tPool = util::ChunkPool::shared()) :
         Player(tClientFormat, tName, tPreloadTime, tFadeInTime, tFadeOutTime),
-        mCrossFadeTimeMusic(tCrossFadeTime)
+        mCrossFadeTimeMusic(tCrossFadeTime),
+        mPremixBuffer(tCompact, std::move(tPool))
     {
         auto sampleCount = clientFormat.sampleRate * clientFormat.channelCount * tPreloadTime;
         auto pagesize = sysconf(_SC_PAGE_SIZE);
@@ -215,8 +219,22 @@ public:
 
         mPremixBuffer.setFadeZone(fadeOutPos, fadeOutLen, fadeInPos, fadeInLen);
 
-        mReader->read(mPremixBuffer);
-        mReader = nullptr;
+        auto cacheKey = pcmCache ? pcmCache->key(tURL) : std::nullopt;
+        if (auto entry = cacheKey ? pcmCache->find(*cacheKey) : nullptr) {
+            FileBuffer<sam_t> cached;
+            cached.map(entry, static_cast<size_t>(seek * clientFormat.sampleRate) * clientFormat.channelCount);
+            premix(cached);
+            log.debug() << "PremixPlayer using cached " << tURL;
+        } else if (cacheKey && seek == 0) {
+            // decoded aside once, the cache needs the samples without crossfade
+            FileBuffer<sam_t> decoded;
+            decoded.resize(sampleCount);
+            if (mReader->read(decoded)) pcmCache->store(*cacheKey, decoded.writePosition(), [&](sam_t* data, size_t pos, size_t len) { decoded.copy(pos, data, len); });
+            premix(decoded);
+        } else {
+            mReader->read(mPremixBuffer);
+        }
+        retire(mReader);
 
         mPremixBuffer.renderFadeOut();
         mPrevTrackDuration = duration;
@@ -235,20 +253,27 @@ public:
     void stop() override {
         log.debug() << "PremixPlayer " << name << " stop...";
         Player::stop();
-        if (mReader) mReader->cancel();
-        mReader = nullptr;
+        if (mReader) mReader->cancel(); // released by the load thread once read returns
         log.debug() << "PremixPlayer " << name << " stopped";
     }
 
 
-    size_t process(const sam_t* in, sam_t* out, size_t nframes) override {
-        auto processed = Player::process(in, out, nframes);
+    size_t mix(const sam_t* in, sam_t* out, size_t nframes, float gain) override {
+        auto processed = Player::mix(in, out, nframes, gain);
         mBufferReadIdxCV.notify_one();
         return processed;
     }
 
 
 private:
+    // writes decoded samples in the reader's block size, so the fade zone is mixed the same way (the last block may be short)
+    void premix(FileBuffer<sam_t>& tSource) {
+        std::vector<sam_t> block(clientFormat.frameSize * clientFormat.channelCount);
+        while (auto len = tSource.read(block.data(), block.size())) {
+            if (mPremixBuffer.write(block.data(), len) != len || len < block.size()) break;
+        }
+    }
+
     void runMonitor() {
         while (mRunning) {
             monitor();
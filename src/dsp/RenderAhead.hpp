@@ -0,0 +1,288 @@
+/*
+ *  Copyright (C) 2024-2025 Christoph Pastl
+ *
+ *  This file is part of Castor.
+ *
+ *  Castor is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Castor is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ *  If you use this program over a network, you must also offer access
+ *  to the source code under the terms of the GNU Lesser General Public License.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "AudioProcessor.hpp"
+#include "Kernels.hpp"
+#include "../util/EngineClock.hpp"
+#include "../util/Log.hpp"
+#include "../util/SPSCRing.hpp"
+
+namespace castor {
+namespace audio {
+
+// Pre-renders a steady file player (faded in, not fading out, no other program playing) into a FIFO a few
+// seconds ahead of the render thread, with the output gain baked in. The render thread then only sums the FIFO
+// into the output and applies fades or gain changes that arrive while it drains.
+//
+// Access to the player's buffer is handed over through mOwner: the worker and the render thread each
+// claim it with a CAS from IDLE, so the render thread can render the remainder live if the FIFO runs dry.
+// The worker stops rendering ahead before the player's next scheduled event, on gain changes and when any other
+// program starts; once the FIFO is drained the render thread takes the player back to live rendering.
+class RenderAhead {
+
+    enum Owner : int {
+        LIVE,       // render thread mixes the player live, worker doesn't touch it
+        REQUESTED,  // worker proposed a player, render thread accepts or rejects it
+        IDLE,       // owned, nobody accessing the player's buffer
+        WORKER,     // worker renders ahead
+        RENDER      // render thread renders the remainder live
+    };
+
+    static constexpr auto kSafetyMargin = std::chrono::milliseconds(500);
+
+    const size_t mChannelCount;
+    const size_t mSampleRate;
+    const size_t mChunkFrames;
+    const std::chrono::milliseconds mAheadTime;
+    util::SPSCRing<sam_t> mFIFO;
+    std::vector<sam_t> mChunk;
+    std::atomic<int> mOwner = LIVE;
+    std::atomic<Player*> mRequested = nullptr;
+    std::atomic<float> mGain = 1.0f;
+    std::atomic<float> mBakedGain = 1.0f;
+    std::atomic<bool> mDraining = false;
+    std::atomic<size_t> mUnderruns = 0;
+    std::atomic<bool> mRunning = false;
+    std::shared_ptr<Player> mOwnedRef = nullptr; // worker thread, keeps the owned player alive
+    Player* mOwned = nullptr; // render thread
+    std::thread mWorker;
+
+public:
+    std::function<std::deque<std::shared_ptr<Player>>()> playersCallback;
+
+    RenderAhead(const AudioStreamFormat& tClientFormat, float tAheadTime) :
+        mChannelCount(tClientFormat.channelCount),
+        mSampleRate(tClientFormat.sampleRate),
+        mChunkFrames(tClientFormat.frameSize),
+        mAheadTime(static_cast<long>(tAheadTime * 1000)),
+        mFIFO(tAheadTime > 0 ? tAheadTime * tClientFormat.sampleRate * tClientFormat.channelCount : 0),
+        mChunk(tClientFormat.frameSize * tClientFormat.channelCount)
+    {}
+
+    ~RenderAhead() {
+        stop();
+    }
+
+    void start() {
+        if (mAheadTime.count() <= 0 || mRunning) return;
+        mRunning = true;
+        mWorker = std::thread(&RenderAhead::work, this);
+    }
+
+    void stop() {
+        mRunning = false;
+        if (mWorker.joinable()) mWorker.join();
+    }
+
+    void setGain(float tGain) {
+        mGain = tGain;
+    }
+
+    size_t bufferedFrames() const {
+        return mFIFO.size() / mChannelCount;
+    }
+
+    size_t underruns() const {
+        return mUnderruns.load(std::memory_order_relaxed);
+    }
+
+
+    // render thread
+
+    // accepts or rejects a player proposed by the worker and returns the player currently rendered ahead
+    template <typename Range>
+    const Player* acquire(const Range& tPlayers) {
+        if (mOwner.load(std::memory_order_acquire) == REQUESTED) {
+            auto player = mRequested.load(std::memory_order_acquire);
+            if (contains(tPlayers, player) && player->isPlaying() && player->isSteady()) {
+                mOwned = player;
+                mOwner.store(RENDER, std::memory_order_release); // keep it until the first block is rendered live
+            } else {
+                mOwner.store(LIVE, std::memory_order_release);
+            }
+        }
+        return mOwned;
+    }
+
+    // sums the pre-rendered FIFO and, if it runs short, the live remainder of the owned player into out
+    template <typename Range>
+    size_t mix(const Range& tPlayers, const sam_t* in, sam_t* out, size_t nframes, float gain) {
+        auto player = mOwned;
+        if (!player) return 0;
+
+        if (!contains(tPlayers, player) || !player->isPlaying()) {
+            mFIFO.clear();
+            mDraining = true;
+            release();
+            return 0;
+        }
+
+        auto bakedGain = mBakedGain.load(std::memory_order_relaxed);
+        auto ratio = bakedGain > 0 ? gain / bakedGain : 0.0f;
+        bool shaped = ratio != 1.0f || !player->isSteady();
+
+        size_t done = 0;
+        mFIFO.peek(nframes * mChannelCount, [&](const sam_t* src, size_t len) {
+            auto frames = len / mChannelCount;
+            if (shaped) player->mixFrom(src, out + done * mChannelCount, frames, ratio);
+            else kernels::mixGain(out + done * mChannelCount, src, len, 1.0f);
+            done += frames;
+        });
+        mFIFO.consume(done * mChannelCount);
+
+        if (player->isFadedOut()) {
+            mFIFO.clear();
+            mDraining = true;
+        }
+        else if (done < nframes) {
+            int idle = IDLE;
+            if (mOwner.load(std::memory_order_relaxed) == RENDER || mOwner.compare_exchange_strong(idle, RENDER)) {
+                done += player->mix(in, out + done * mChannelCount, nframes - done, gain);
+                mOwner.store(IDLE, std::memory_order_release);
+            } else {
+                mUnderruns.fetch_add(1, std::memory_order_relaxed); // worker holds the buffer
+            }
+        }
+
+        if (mDraining && mFIFO.empty()) release();
+        return done;
+    }
+
+private:
+    template <typename Range>
+    static bool contains(const Range& tPlayers, const Player* tPlayer) {
+        for (auto player : tPlayers) {
+            if (player == tPlayer) return true;
+        }
+        return false;
+    }
+
+    void release() {
+        int idle = IDLE;
+        if (mOwner.load(std::memory_order_relaxed) == RENDER) mOwner.store(IDLE, std::memory_order_relaxed);
+        if (mOwner.compare_exchange_strong(idle, LIVE)) mOwned = nullptr;
+    }
+
+
+    // worker thread
+
+    // next point in time after which the output of tPlayer can't be rendered ahead anymore
+    std::chrono::system_clock::time_point nextEvent(const Player& tPlayer, const std::deque<std::shared_ptr<Player>>& tPlayers, std::chrono::system_clock::time_point tNow) {
+        auto next = tPlayer.fadeOutPoint();
+        for (const auto& player : tPlayers) {
+            if (player.get() == &tPlayer || !player->playItem) continue;
+            if (player->isPlaying()) return tNow; // another program is audible
+            if (player->playItem->end < std::chrono::system_clock::to_time_t(tNow)) continue;
+            next = std::min(next, std::chrono::system_clock::from_time_t(player->playItem->start));
+        }
+        return next;
+    }
+
+    std::chrono::system_clock::time_point bufferedUntil(std::chrono::system_clock::time_point tNow) const {
+        return tNow + std::chrono::milliseconds((bufferedFrames() + mChunkFrames) * 1000 / mSampleRate) + kSafetyMargin;
+    }
+
+    std::shared_ptr<Player> findCandidate(const std::deque<std::shared_ptr<Player>>& tPlayers, std::chrono::system_clock::time_point tNow) {
+        std::shared_ptr<Player> candidate = nullptr;
+        for (const auto& player : tPlayers) {
+            if (!player->isPlaying()) continue;
+            if (candidate) return nullptr; // more than one program audible
+            candidate = player;
+        }
+        if (!candidate || !candidate->canRenderAhead() || !candidate->isSteady() || !candidate->playItem) return nullptr;
+        if (tNow + mAheadTime + kSafetyMargin >= nextEvent(*candidate, tPlayers, tNow)) return nullptr;
+        return candidate;
+    }
+
+    bool canContinue(const std::deque<std::shared_ptr<Player>>& tPlayers, std::chrono::system_clock::time_point tNow) {
+        if (!mOwnedRef->isPlaying() || !mOwnedRef->isSteady()) return false;
+        if (mGain.load() != mBakedGain.load()) return false; // manual gain change
+        return bufferedUntil(tNow) < nextEvent(*mOwnedRef, tPlayers, tNow);
+    }
+
+    void work() {
+        const auto pollInterval = std::chrono::milliseconds(mChunkFrames * 1000 / mSampleRate / 2 + 1);
+
+        while (mRunning) {
+            auto owner = mOwner.load(std::memory_order_acquire);
+            auto now = util::EngineClock::now();
+
+            if (owner == LIVE) {
+                if (mOwnedRef) {
+                    log.debug() << "RenderAhead released " << mOwnedRef->name;
+                    mOwnedRef = nullptr;
+                }
+                auto players = playersCallback ? playersCallback() : std::deque<std::shared_ptr<Player>>{};
+                if (auto candidate = findCandidate(players, now)) {
+                    log.debug() << "RenderAhead requesting " << candidate->name;
+                    mOwnedRef = candidate;
+                    mDraining = false;
+                    mBakedGain = mGain.load();
+                    mRequested.store(candidate.get(), std::memory_order_release);
+                    mOwner.store(REQUESTED, std::memory_order_release);
+                }
+                util::EngineClock::sleepFor(pollInterval);
+                continue;
+            }
+
+            if (owner == REQUESTED || mDraining) {
+                util::EngineClock::sleepFor(pollInterval);
+                continue;
+            }
+
+            if (mFIFO.writable() < mChunk.size()) {
+                util::EngineClock::sleepFor(pollInterval);
+                continue;
+            }
+
+            auto players = playersCallback ? playersCallback() : std::deque<std::shared_ptr<Player>>{};
+            if (!canContinue(players, now)) {
+                log.debug() << "RenderAhead draining " << mOwnedRef->name;
+                mDraining = true;
+                continue;
+            }
+
+            int idle = IDLE;
+            if (!mOwner.compare_exchange_strong(idle, WORKER)) {
+                std::this_thread::yield();
+                continue;
+            }
+            auto frames = mOwnedRef->renderAhead(mChunk.data(), mChunkFrames, mBakedGain);
+            mFIFO.write(mChunk.data(), frames * mChannelCount);
+            mOwner.store(IDLE, std::memory_order_release);
+
+            if (frames < mChunkFrames) mDraining = true; // end of buffer
+        }
+    }
+};
+
+}
+}
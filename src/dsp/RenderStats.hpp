@@ -0,0 +1,192 @@
+/*
+ *  Copyright (C) 2024-2025 Christoph Pastl
+ *
+ *  This file is part of Castor.
+ *
+ *  Castor is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Castor is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ *  If you use this program over a network, you must also offer access
+ *  to the source code under the terms of the GNU Lesser General Public License.
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <json.hpp>
+#include "audio.hpp"
+
+namespace castor {
+namespace audio {
+
+// Lock-free timing statistics of the rendering cycle. The render thread is the only writer:
+// it stamps the end of each stage into a log2 histogram of nanoseconds and relates the whole
+// callback to its deadline (nframes / sample rate). Readers take relaxed snapshots from any thread.
+class RenderStats {
+public:
+    enum Stage : uint8_t {
+        INPUT_METER,
+        PLAYERS,
+        SILENCE_DETECTOR,
+        FALLBACK,
+        SCHEDULE_RECORDER,
+        BLOCK_RECORDER,
+        STREAM_OUTPUT,
+        STREAM_PROVIDER,
+        CALLBACK,
+        kNumStages
+    };
+
+    static constexpr const char* kStageNames[kNumStages] = {
+        "inputMeter", "players", "silenceDetector", "fallback", "scheduleRecorder", "blockRecorder", "streamOutput", "streamProvider", "callback"
+    };
+
+    using Clock = std::chrono::steady_clock;
+
+    // bucket i counts durations in [2^(i-1), 2^i) ns, the last bucket everything above
+    class Histogram {
+    public:
+        static constexpr size_t kNumBuckets = 32;
+
+    private:
+        std::array<std::atomic<uint64_t>, kNumBuckets> mBuckets{};
+        std::atomic<uint64_t> mCount = 0;
+        std::atomic<uint64_t> mSumNs = 0;
+        std::atomic<uint64_t> mMaxNs = 0;
+
+        static void increment(std::atomic<uint64_t>& tValue, uint64_t tAmount = 1) {
+            // single writer: no read-modify-write instruction needed
+            tValue.store(tValue.load(std::memory_order_relaxed) + tAmount, std::memory_order_relaxed);
+        }
+
+    public:
+        void record(uint64_t tNs) {
+            auto bucket = std::min<size_t>(std::bit_width(tNs), kNumBuckets - 1);
+            increment(mBuckets[bucket]);
+            increment(mCount);
+            increment(mSumNs, tNs);
+            if (tNs > mMaxNs.load(std::memory_order_relaxed)) mMaxNs.store(tNs, std::memory_order_relaxed);
+        }
+
+        uint64_t count() const { return mCount.load(std::memory_order_relaxed); }
+        uint64_t maxNs() const { return mMaxNs.load(std::memory_order_relaxed); }
+
+        double meanNs() const {
+            auto n = count();
+            return n ? double(mSumNs.load(std::memory_order_relaxed)) / n : 0.0;
+        }
+
+        // upper bound of the bucket containing the given quantile (0..1)
+        uint64_t quantileNs(double tQuantile) const {
+            std::array<uint64_t, kNumBuckets> buckets;
+            uint64_t total = 0;
+            for (size_t i = 0; i < kNumBuckets; ++i) total += buckets[i] = mBuckets[i].load(std::memory_order_relaxed);
+            if (total == 0) return 0;
+            auto target = uint64_t(tQuantile * (total - 1)) + 1;
+            uint64_t acc = 0;
+            for (size_t i = 0; i < kNumBuckets; ++i) {
+                acc += buckets[i];
+                if (acc >= target) return std::min(uint64_t(1) << i, maxNs());
+            }
+            return maxNs();
+        }
+
+        nlohmann::json getJSON() const {
+            nlohmann::json buckets = nlohmann::json::array();
+            for (const auto& bucket : mBuckets) buckets.push_back(bucket.load(std::memory_order_relaxed));
+            return {
+                {"count", count()},
+                {"meanUs", meanNs() / 1000.0},
+                {"p50Us", quantileNs(0.5) / 1000.0},
+                {"p99Us", quantileNs(0.99) / 1000.0},
+                {"p999Us", quantileNs(0.999) / 1000.0},
+                {"maxUs", maxNs() / 1000.0},
+                {"buckets", buckets}
+            };
+        }
+    };
+
+private:
+    const double mSampleRate;
+    std::array<Histogram, kNumStages> mStages;
+    Clock::time_point mCallbackStart;
+    Clock::time_point mStageStart;
+    std::atomic<float> mLoad = 0.0f;
+    std::atomic<float> mPeakLoad = 0.0f;
+    std::atomic<uint64_t> mBusyNs = 0;
+    std::atomic<uint64_t> mDeadlineNs = 0;
+    std::atomic<uint64_t> mOverruns = 0;
+
+public:
+    RenderStats(const AudioStreamFormat& tClientFormat) :
+        mSampleRate(tClientFormat.sampleRate)
+    {}
+
+    // render thread
+
+    void begin() {
+        mCallbackStart = mStageStart = Clock::now();
+    }
+
+    // records the time since the previous stage ended (or the callback began)
+    void lap(Stage tStage) {
+        auto now = Clock::now();
+        mStages[tStage].record(std::chrono::duration_cast<std::chrono::nanoseconds>(now - mStageStart).count());
+        mStageStart = now;
+    }
+
+    void end(size_t nframes) {
+        auto busyNs = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - mCallbackStart).count();
+        auto deadlineNs = uint64_t(nframes * 1e9 / mSampleRate);
+        mStages[CALLBACK].record(busyNs);
+        auto load = deadlineNs ? float(busyNs) / deadlineNs : 0.0f;
+        mLoad.store(load, std::memory_order_relaxed);
+        if (load > mPeakLoad.load(std::memory_order_relaxed)) mPeakLoad.store(load, std::memory_order_relaxed);
+        mBusyNs.store(mBusyNs.load(std::memory_order_relaxed) + busyNs, std::memory_order_relaxed);
+        mDeadlineNs.store(mDeadlineNs.load(std::memory_order_relaxed) + deadlineNs, std::memory_order_relaxed);
+        if (load > 1.0f) mOverruns.store(mOverruns.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    // any thread
+
+    const Histogram& stage(Stage tStage) const { return mStages[tStage]; }
+
+    // busy time of the last callback relative to its deadline
+    float load() const { return mLoad.load(std::memory_order_relaxed); }
+    float peakLoad() const { return mPeakLoad.load(std::memory_order_relaxed); }
+    uint64_t overruns() const { return mOverruns.load(std::memory_order_relaxed); }
+
+    // busy time of all callbacks relative to their deadlines
+    float averageLoad() const {
+        auto deadlineNs = mDeadlineNs.load(std::memory_order_relaxed);
+        return deadlineNs ? float(mBusyNs.load(std::memory_order_relaxed)) / deadlineNs : 0.0f;
+    }
+
+    nlohmann::json getJSON() const {
+        nlohmann::json stages = {};
+        for (size_t i = 0; i < kNumStages; ++i) stages[kStageNames[i]] = mStages[i].getJSON();
+        return {
+            {"load", load()},
+            {"averageLoad", averageLoad()},
+            {"peakLoad", peakLoad()},
+            {"overruns", overruns()},
+            {"stages", stages}
+        };
+    }
+};
+
+}
+}
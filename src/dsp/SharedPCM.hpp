@@ -0,0 +1,94 @@
+/*
+ *  Copyright (C) 2024-2025 Christoph Pastl
+ *
+ *  This file is part of Castor.
+ *
+ *  Castor is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Castor is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ *  If you use this program over a network, you must also offer access
+ *  to the source code under the terms of the GNU Lesser General Public License.
+ */
+
+
+#pragma once
+
+#include <atomic>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include "audio.hpp"
+#include "../util/Log.hpp"
+
+namespace castor {
+namespace audio {
+
+template <typename T>
+class FileBuffer;
+
+// Decoded items currently held by players, so further players of the same file and seek offset
+// (station IDs, jingles, looped playlists) read the same samples instead of decoding their own copy.
+// Entries are weak: the samples are released with the last player reading them. A buffer whose played
+// chunks were released by its only reader refuses further readers, which then decode again.
+class SharedPCM {
+public:
+    using Buffer = FileBuffer<sam_t>;
+
+private:
+    std::mutex mMutex;
+    std::unordered_map<std::string, std::weak_ptr<Buffer>> mBuffers;
+    std::atomic<size_t> mHits = 0;
+
+public:
+    // identifies the decoded samples of a file from tOffset on (empty if the file can't be found)
+    static std::string key(const std::string& tURL, size_t tOffset, bool tCompact) {
+        std::error_code ec;
+        auto size = std::filesystem::file_size(tURL, ec);
+        if (ec) return "";
+        auto time = std::filesystem::last_write_time(tURL, ec).time_since_epoch().count();
+        if (ec) return "";
+        return tURL + "|" + std::to_string(size) + "|" + std::to_string(time) + "|" + std::to_string(tOffset) + (tCompact ? "|c" : "");
+    }
+
+    std::shared_ptr<Buffer> find(const std::string& tKey) {
+        if (tKey.empty()) return nullptr;
+        std::lock_guard<std::mutex> lock(mMutex);
+        auto it = mBuffers.find(tKey);
+        if (it == mBuffers.end()) return nullptr;
+        auto buffer = it->second.lock();
+        if (!buffer) {
+            mBuffers.erase(it);
+            return nullptr;
+        }
+        mHits.fetch_add(1, std::memory_order_relaxed);
+        return buffer;
+    }
+
+    // offers completely decoded samples to later loads
+    void publish(const std::string& tKey, std::shared_ptr<Buffer> tBuffer) {
+        if (tKey.empty()) return;
+        std::lock_guard<std::mutex> lock(mMutex);
+        std::erase_if(mBuffers, [](const auto& entry) { return entry.second.expired(); });
+        mBuffers[tKey] = std::move(tBuffer);
+    }
+
+    // loads served from samples already decoded
+    size_t hits() const {
+        return mHits.load(std::memory_order_relaxed);
+    }
+};
+
+}
+}
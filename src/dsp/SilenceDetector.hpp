@@ -27,6 +27,7 @@
 #include <atomic>
 #include <limits>
 #include <thread>
+#include "Kernels.hpp"
 #include "../util/Log.hpp"
 
 namespace castor {
@@ -46,6 +47,7 @@ class SilenceDetector {
     std::atomic<bool> mRunning = false;
     std::atomic<bool> mSilence = false;
     std::atomic<float> mCurrRMS = 0;
+    std::atomic<float> mGain = 1.0f;
     std::thread mWorker;
     std::mutex mMutex;
     std::condition_variable mCV;
@@ -80,6 +82,11 @@ public:
         return mCurrRMS;
     }
 
+    // gain already applied to the analyzed signal; the threshold follows it so silence stays relative to the program level
+    void setGain(float tGain) {
+        mGain = tGain;
+    }
+
 
     void setSilence(bool tSilence) {
         if (mSilence != tSilence) {
@@ -106,15 +113,10 @@ public:
             if (!mRunning) return;
 
             // read safe area without locking
-            float sqSum = 0;
-            for (auto i = mBufferReadIdx; i < mBufferReadIdx + halfSz; ++i) sqSum += mBuffer[i] * mBuffer[i];
+            mCurrRMS = kernels::rms(mBuffer.data() + mBufferReadIdx, halfSz);
             mBufferReadIdx += halfSz;
             if (mBufferReadIdx >= mBuffer.size()) mBufferReadIdx = 0;
 
-            // time for "expensive" operations
-            sqSum /= halfSz;
-            mCurrRMS = sqSum > 0 ? sqrt(sqSum) : 0;
-
             calcSilence();
 
             // log.debug() << "SilenceDetector work done " << util::linearDB(mCurrRMS);
@@ -122,8 +124,8 @@ public:
     }
 
     void calcSilence() {
-        auto now = std::time(0);
-        bool silence = mCurrRMS < mThresholdLin;
+        auto now = util::EngineClock::time();
+        bool silence = mCurrRMS < mThresholdLin * mGain;
         if (silence) {
             if (mSilenceStart == 0) {
                 mSilenceStart = now;
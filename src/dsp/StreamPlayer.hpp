@@ -29,6 +29,7 @@
 #include "AudioProcessor.hpp"
 #include "CodecReader.hpp"
 #include "../util/Log.hpp"
+#include "../util/MemoryPages.hpp"
 #include "../util/util.hpp"
 
 namespace castor {
@@ -45,21 +46,26 @@ class StreamBuffer : public SourceBuffer<T> {
     std::vector<T> mBuffer;
     std::mutex mMutex;
     std::condition_variable mCV;
+    std::mutex mLockMutex;
+    bool mLocked = false;
 
 public:
+    ~StreamBuffer() {
+        unlock();
+    }
+
     size_t readPosition() override { return mReadPos; }
     size_t writePosition() override { return mWritePos; }
     size_t capacity() override { return mCapacity; }
 
-    float memorySizeMiB() override {
-        static constexpr float kibi = 1024.0f;
-        static constexpr float mibi = kibi * kibi;
-        float bytesz = mCapacity * sizeof(T);
-        return bytesz / mibi;
+    size_t memorySize() override {
+        return mBuffer.capacity() * sizeof(T);
     }
 
     void resize(size_t tCapacity) override {
         assert(tCapacity == 0 || std::has_single_bit(tCapacity)); // allow 0 or pow2s only
+        std::lock_guard<std::mutex> lock(mLockMutex);
+        unlock();
         mReadPos = 0;
         mWritePos = 0;
         mSize = 0;
@@ -69,6 +75,13 @@ public:
         mCancelled = false;
     }
     
+    // the ring is small and read all around, so it is locked as a whole
+    void lockWindow(size_t tAhead) override {
+        std::lock_guard<std::mutex> lock(mLockMutex);
+        if (tAhead == 0) unlock();
+        else if (!mLocked && !mBuffer.empty()) mLocked = util::MemoryPages::lock(mBuffer.data(), mBuffer.size() * sizeof(T));
+    }
+
     void cancel() {
         mCancelled.store(true, std::memory_order_release);
         mCV.notify_all();
@@ -120,6 +133,35 @@ public:
 
         return tLen;
     }
+
+    size_t mix(T* tData, size_t tLen, const float* tGain, size_t tChannels) override {
+        if (!tData || tLen == 0) return 0;
+
+        auto available = mSize.load(std::memory_order_relaxed);
+        if (tLen > available) return 0;
+
+        auto readable = std::min(tLen, mCapacity - mReadPos);
+        kernels::mixRamp(tData, &mBuffer[mReadPos], readable, tGain, tChannels);
+
+        auto overlap = tLen - readable;
+        if (overlap > 0) {
+            kernels::mixRamp(tData + readable, &mBuffer[0], overlap, tGain + readable / tChannels, tChannels); // positions stay frame aligned
+        }
+
+        mReadPos.store((mReadPos.load(std::memory_order_relaxed) + tLen) & mCapacityMask, std::memory_order_relaxed);
+        mSize.store(mSize.load(std::memory_order_relaxed) - tLen, std::memory_order_release);
+
+        mCV.notify_one();
+
+        return tLen;
+    }
+
+private:
+    void unlock() {
+        if (!mLocked) return;
+        util::MemoryPages::unlock(mBuffer.data(), mBuffer.size() * sizeof(T));
+        mLocked = false;
+    }
 };
 
 class StreamPlayer : public Player {
@@ -174,7 +216,7 @@ public:
         mStreamBuffer.cancel();
         if (mReader) mReader->cancel();
         if (mLoadWorker.joinable()) mLoadWorker.join();
-        mReader = nullptr;
+        retire(mReader);
         
         log.debug() << "StreamPlayer " << name << " stopped";
     }
@@ -0,0 +1,163 @@
+/*
+ *  Copyright (C) 2024-2025 Christoph Pastl
+ *
+ *  This file is part of Castor.
+ *
+ *  Castor is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Castor is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ *  If you use this program over a network, you must also offer access
+ *  to the source code under the terms of the GNU Lesser General Public License.
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <mutex>
+#include "AudioProcessor.hpp"
+#include "../util/EngineClock.hpp"
+#include "../util/SPSCRing.hpp"
+
+namespace castor {
+namespace audio {
+
+// Player transitions stamped in sample frames and applied by the render thread at the exact frame.
+// Producers (scheduling threads) post events ahead of time; the render thread splits its block at the
+// frames of due events. Wall clock times are mapped to frames through an anchor (frame, time) that the
+// render thread publishes every block, smoothed against callback jitter.
+class Timeline {
+public:
+    struct Event {
+        uint64_t frame;
+        Player* player;
+        uint64_t playerId;
+        Player::Transition transition;
+    };
+
+private:
+    static constexpr size_t kQueueSize = 1024;
+    static constexpr size_t kMaxPending = 256;
+    static constexpr double kAnchorSmoothing = 0.01;
+    static constexpr int64_t kAnchorResyncNs = 50'000'000; // re-anchor after stalls or restarts
+
+    const double mSampleRate;
+    util::SPSCRing<Event> mQueue;
+    std::mutex mPostMutex; // serializes producers
+    std::atomic<uint64_t> mAnchorSeq = 0;
+    std::atomic<uint64_t> mAnchorFrame = 0;
+    std::atomic<int64_t> mAnchorNs = 0;
+    std::atomic<size_t> mLateEvents = 0;
+
+    // render thread
+    std::array<Event, kMaxPending> mPending;
+    size_t mPendingCount = 0;
+    uint64_t mPosition = 0;
+    size_t mLastBlockFrames = 0;
+    double mSmoothedNs = 0;
+
+public:
+    Timeline(const AudioStreamFormat& tClientFormat) :
+        mSampleRate(tClientFormat.sampleRate),
+        mQueue(kQueueSize)
+    {}
+
+    size_t lateEvents() const {
+        return mLateEvents.load(std::memory_order_relaxed);
+    }
+
+    // frame rendered at a wall clock time, -1 if the render thread hasn't run yet
+    int64_t frameAt(std::chrono::system_clock::time_point tTime) const {
+        uint64_t seq, frame;
+        int64_t ns;
+        do {
+            seq = mAnchorSeq.load(std::memory_order_acquire);
+            frame = mAnchorFrame.load(std::memory_order_relaxed);
+            ns = mAnchorNs.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+        } while ((seq & 1) || seq != mAnchorSeq.load(std::memory_order_relaxed));
+        if (seq == 0) return -1;
+
+        auto deltaNs = std::chrono::duration_cast<std::chrono::nanoseconds>(tTime.time_since_epoch()).count() - ns;
+        auto target = static_cast<int64_t>(frame) + std::llround(deltaNs * mSampleRate / 1e9);
+        return std::max<int64_t>(target, 0);
+    }
+
+    // any non-realtime thread
+    bool post(Player* tPlayer, Player::Transition tTransition, std::chrono::system_clock::time_point tTime) {
+        auto frame = frameAt(tTime);
+        if (frame < 0) return false;
+        std::lock_guard<std::mutex> lock(mPostMutex);
+        return mQueue.push({static_cast<uint64_t>(frame), tPlayer, tPlayer->id, tTransition});
+    }
+
+
+    // render thread
+
+    void begin(size_t nframes) {
+        auto nowNs = std::chrono::duration_cast<std::chrono::nanoseconds>(util::EngineClock::now().time_since_epoch()).count();
+        auto predicted = mSmoothedNs + mLastBlockFrames * 1e9 / mSampleRate;
+        auto error = nowNs - predicted;
+        mSmoothedNs = (mSmoothedNs == 0 || std::abs(error) > kAnchorResyncNs) ? nowNs : predicted + error * kAnchorSmoothing;
+
+        auto seq = mAnchorSeq.load(std::memory_order_relaxed);
+        mAnchorSeq.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        mAnchorFrame.store(mPosition, std::memory_order_relaxed);
+        mAnchorNs.store(static_cast<int64_t>(mSmoothedNs), std::memory_order_relaxed);
+        mAnchorSeq.store(seq + 2, std::memory_order_release);
+
+        Event event;
+        while (mPendingCount < kMaxPending && mQueue.pop(event)) {
+            // keep pending events sorted by frame (stable for equal frames)
+            auto i = mPendingCount++;
+            for (; i > 0 && mPending[i - 1].frame > event.frame; --i) mPending[i] = mPending[i - 1];
+            mPending[i] = event;
+        }
+    }
+
+    // applies all events due at tOffset into the block and returns the number of frames until the next one
+    template <typename Range>
+    size_t dispatch(const Range& tPlayers, size_t tOffset, size_t nframes) {
+        auto frame = mPosition + tOffset;
+        size_t applied = 0;
+        while (applied < mPendingCount && mPending[applied].frame <= frame) {
+            const auto& event = mPending[applied++];
+            if (event.frame < frame && tOffset == 0) mLateEvents.fetch_add(1, std::memory_order_relaxed);
+            for (auto player : tPlayers) {
+                if (player == event.player && player->id == event.playerId) {
+                    player->apply(event.transition);
+                    break;
+                }
+            }
+        }
+        if (applied) {
+            std::move(mPending.begin() + applied, mPending.begin() + mPendingCount, mPending.begin());
+            mPendingCount -= applied;
+        }
+
+        auto remaining = nframes - tOffset;
+        if (mPendingCount == 0) return remaining;
+        return std::min<uint64_t>(remaining, mPending[0].frame - frame);
+    }
+
+    void end(size_t nframes) {
+        mPosition += nframes;
+        mLastBlockFrames = nframes;
+    }
+};
+
+}
+}
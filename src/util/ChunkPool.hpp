@@ -0,0 +1,144 @@
+/*
+ *  Copyright (C) 2024-2025 Christoph Pastl
+ *
+ *  This file is part of Castor.
+ *
+ *  Castor is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Castor is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ *  If you use this program over a network, you must also offer access
+ *  to the source code under the terms of the GNU Lesser General Public License.
+ */
+
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <vector>
+#include <sys/mman.h>
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+#include "Log.hpp"
+#include "MemoryPages.hpp"
+
+namespace castor {
+namespace util {
+
+// Fixed-size memory blocks for sample buffers that grow in steps instead of reallocating.
+// Chunks are mapped from the OS directly (not initialized, no heap fragmentation) and released
+// chunks are kept (up to a limit) and handed out again, so consecutive loads reuse mapped memory.
+// trim() hands the memory of idle chunks back to the OS while keeping them for reuse.
+// Chunks can be backed by huge pages and are pre-faulted on acquire (on the loading thread),
+// so the render thread reading them neither takes page faults nor walks 4 KiB TLB entries.
+class ChunkPool {
+public:
+    static constexpr size_t kChunkSize = 1 << 21; // bytes, 2 MiB
+
+private:
+    struct Chunk {
+        void* addr;
+        bool resident; // touched since the last trim
+    };
+
+    const size_t mMaxFree;
+    const MemoryPages::HugePages mHugePages;
+    const bool mPrefault;
+    std::mutex mMutex;
+    std::vector<Chunk> mFree;
+    std::atomic<size_t> mUsed = 0;
+
+public:
+    // keeps up to tMaxFree released chunks for reuse
+    ChunkPool(size_t tMaxFree = 32, MemoryPages::HugePages tHugePages = MemoryPages::HUGE_OFF, bool tPrefault = true) :
+        mMaxFree(tMaxFree),
+        mHugePages(tHugePages),
+        mPrefault(tPrefault)
+    {}
+
+    ~ChunkPool() {
+        for (const auto& chunk : mFree) MemoryPages::unmap(chunk.addr, kChunkSize);
+    }
+
+    ChunkPool(const ChunkPool&) = delete;
+    ChunkPool& operator=(const ChunkPool&) = delete;
+
+    // default pool of the process (for buffers not created by a PlayerFactory)
+    static std::shared_ptr<ChunkPool> shared() {
+        static auto pool = std::make_shared<ChunkPool>();
+        return pool;
+    }
+
+    void* acquire() {
+        Chunk chunk = {nullptr, false};
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            if (!mFree.empty()) {
+                chunk = mFree.back();
+                mFree.pop_back();
+            }
+        }
+        if (!chunk.addr) chunk.addr = MemoryPages::map(kChunkSize, mHugePages);
+        if (mPrefault && !chunk.resident) MemoryPages::prefault(chunk.addr, kChunkSize);
+        mUsed.fetch_add(1, std::memory_order_relaxed);
+        return chunk.addr;
+    }
+
+    void release(void* tChunk) {
+        if (!tChunk) return;
+        mUsed.fetch_sub(1, std::memory_order_relaxed);
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            if (mFree.size() < mMaxFree) {
+                mFree.push_back({tChunk, true});
+                return;
+            }
+        }
+        MemoryPages::unmap(tChunk, kChunkSize);
+    }
+
+    // returns the pages of idle chunks (and free heap memory) to the OS
+    void trim() {
+        size_t trimmed = 0;
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            for (auto& chunk : mFree) {
+                if (!chunk.resident) continue;
+                madvise(chunk.addr, kChunkSize, MADV_DONTNEED); // not supported for reserved huge pages on older kernels
+                chunk.resident = false;
+                ++trimmed;
+            }
+        }
+        #if defined(__GLIBC__)
+        malloc_trim(0);
+        #endif
+        if (trimmed) log.debug() << "ChunkPool trimmed " << trimmed << " idle chunks";
+    }
+
+    // bytes handed out to buffers
+    size_t usedBytes() const {
+        return mUsed.load(std::memory_order_relaxed) * kChunkSize;
+    }
+
+    // bytes kept for reuse
+    size_t freeBytes() {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mFree.size() * kChunkSize;
+    }
+};
+
+}
+}
@@ -0,0 +1,139 @@
+/*
+ *  Copyright (C) 2024-2025 Christoph Pastl
+ *
+ *  This file is part of Castor.
+ *
+ *  Castor is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Castor is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ *  If you use this program over a network, you must also offer access
+ *  to the source code under the terms of the GNU Lesser General Public License.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <ctime>
+#include <mutex>
+#include <thread>
+
+namespace castor {
+namespace util {
+
+// Wall clock of the engine. Scheduling code reads time from here instead of std::time(0), so a
+// headless driver can switch it to virtual time and advance it per rendered block.
+// Virtual sleeps end when the virtual deadline is reached, but never last longer than the same
+// duration in real time, so polling loops keep running while the driver waits for them.
+// After release(), virtual time continues at real speed from where the driver left it.
+class EngineClock {
+public:
+    using Clock = std::chrono::system_clock;
+    using time_point = Clock::time_point;
+    using duration = Clock::duration;
+
+private:
+    static constexpr auto kPollInterval = std::chrono::milliseconds(5);
+
+    static inline std::atomic<bool> sVirtual = false;
+    static inline std::atomic<bool> sReleased = false;
+    static inline std::atomic<int64_t> sVirtualNs = 0;
+    static inline std::atomic<int64_t> sReleasedAtNs = 0; // steady clock
+    static inline std::mutex sMutex;
+    static inline std::condition_variable sCV;
+
+    static int64_t steadyNs() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+public:
+    static bool isVirtual() {
+        return sVirtual.load(std::memory_order_acquire);
+    }
+
+    static time_point now() {
+        if (!isVirtual()) return Clock::now();
+        auto ns = sVirtualNs.load(std::memory_order_acquire);
+        if (sReleased.load(std::memory_order_acquire)) ns += steadyNs() - sReleasedAtNs.load(std::memory_order_relaxed);
+        return time_point(std::chrono::duration_cast<duration>(std::chrono::nanoseconds(ns)));
+    }
+
+    static time_t time() {
+        return Clock::to_time_t(now());
+    }
+
+    // driver
+
+    // stops the clock at tStart; from now on it only moves by advance()
+    static void setVirtual(time_point tStart) {
+        sVirtualNs = std::chrono::duration_cast<std::chrono::nanoseconds>(tStart.time_since_epoch()).count();
+        sReleased = false;
+        sVirtual = true;
+    }
+
+    static void advance(std::chrono::nanoseconds tDuration) {
+        {
+            std::lock_guard<std::mutex> lock(sMutex);
+            sVirtualNs.fetch_add(tDuration.count(), std::memory_order_acq_rel);
+        }
+        sCV.notify_all();
+    }
+
+    // lets virtual time run on at real speed (e.g. while shutting down after a headless run)
+    static void release() {
+        {
+            std::lock_guard<std::mutex> lock(sMutex);
+            if (sReleased) return;
+            sReleasedAtNs = steadyNs();
+            sReleased = true;
+        }
+        sCV.notify_all();
+    }
+
+    // sleeping and waiting
+
+    static void sleepUntil(time_point tTime) {
+        if (!isVirtual()) {
+            std::this_thread::sleep_until(tTime);
+            return;
+        }
+        auto realDeadline = std::chrono::steady_clock::now() + (tTime - now());
+        std::unique_lock<std::mutex> lock(sMutex);
+        sCV.wait_until(lock, realDeadline, [&] { return now() >= tTime; });
+    }
+
+    static void sleepFor(duration tDuration) {
+        sleepUntil(now() + tDuration);
+    }
+
+    // waits on a foreign condition variable until tPredicate holds or tTime has passed in engine time
+    template <typename Predicate>
+    static bool waitUntil(std::condition_variable& tCV, std::unique_lock<std::mutex>& tLock, time_point tTime, Predicate tPredicate) {
+        if (!isVirtual()) return tCV.wait_until(tLock, tTime, tPredicate);
+        auto realDeadline = std::chrono::steady_clock::now() + (tTime - now());
+        while (!tPredicate()) {
+            if (now() >= tTime || std::chrono::steady_clock::now() >= realDeadline) return tPredicate();
+            tCV.wait_for(tLock, kPollInterval);
+        }
+        return true;
+    }
+
+    template <typename Predicate>
+    static bool waitFor(std::condition_variable& tCV, std::unique_lock<std::mutex>& tLock, duration tDuration, Predicate tPredicate) {
+        return waitUntil(tCV, tLock, now() + tDuration, tPredicate);
+    }
+};
+
+}
+}
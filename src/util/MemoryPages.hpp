@@ -0,0 +1,189 @@
+/*
+ *  Copyright (C) 2024-2025 Christoph Pastl
+ *
+ *  This file is part of Castor.
+ *
+ *  Castor is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Castor is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ *  If you use this program over a network, you must also offer access
+ *  to the source code under the terms of the GNU Lesser General Public License.
+ */
+
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <string>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include "Log.hpp"
+
+namespace castor {
+namespace util {
+
+// Page-level control over memory read by the render thread: huge page backing, pre-faulting on the
+// calling (loader) thread and locking into RAM, with the locked bytes counted process-wide.
+class MemoryPages {
+public:
+    enum HugePages {
+        HUGE_OFF,         // regular pages
+        HUGE_TRANSPARENT, // aligned and advised for transparent huge pages
+        HUGE_EXPLICIT     // reserved huge pages (hugetlbfs), transparent if none are available
+    };
+
+    static constexpr size_t kHugePageSize = 1 << 21;
+
+private:
+    static inline std::atomic<size_t> sLockedBytes = 0;
+    static inline std::atomic<bool> sLockDisabled = false; // by a refused mlock (no permission), until RLIMIT_MEMLOCK changes
+    static inline std::atomic<rlim_t> sLockLimit = 0; // RLIMIT_MEMLOCK when locking was disabled
+    static inline std::atomic<size_t> sLockFullAt = SIZE_MAX; // locked bytes when the limit was reached, retried below
+    static inline std::atomic<bool> sLockFullLogged = false;
+    static inline std::atomic<bool> sHugeFailed = false;
+
+    static size_t pageSize() {
+        static const size_t size = sysconf(_SC_PAGE_SIZE);
+        return size;
+    }
+
+    // page range covering [tAddr, tAddr + tLen)
+    static std::pair<uintptr_t, size_t> pages(const void* tAddr, size_t tLen) {
+        auto mask = pageSize() - 1;
+        auto begin = reinterpret_cast<uintptr_t>(tAddr) & ~mask;
+        auto end = (reinterpret_cast<uintptr_t>(tAddr) + tLen + mask) & ~mask;
+        return {begin, end - begin};
+    }
+
+    static rlim_t lockLimit() {
+        struct rlimit limit;
+        return getrlimit(RLIMIT_MEMLOCK, &limit) == 0 ? limit.rlim_cur : 0;
+    }
+
+public:
+    // maps tLen bytes (a multiple of kHugePageSize for huge pages), not initialized
+    static void* map(size_t tLen, HugePages tHugePages = HUGE_OFF) {
+        #ifdef MAP_HUGETLB
+        if (tHugePages == HUGE_EXPLICIT && !sHugeFailed) {
+            auto addr = mmap(nullptr, tLen, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (addr != MAP_FAILED) return addr;
+            if (!sHugeFailed.exchange(true)) log.warn() << "MemoryPages no reserved huge pages available (" << strerror(errno) << ") - using transparent huge pages";
+        }
+        #endif
+        if (tHugePages == HUGE_OFF) {
+            auto addr = mmap(nullptr, tLen, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (addr == MAP_FAILED) throw std::bad_alloc();
+            return addr;
+        }
+        // over-map to cut out a huge page aligned region
+        auto raw = mmap(nullptr, tLen + kHugePageSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (raw == MAP_FAILED) throw std::bad_alloc();
+        auto begin = reinterpret_cast<uintptr_t>(raw);
+        auto aligned = (begin + kHugePageSize - 1) & ~(kHugePageSize - 1);
+        if (aligned > begin) munmap(raw, aligned - begin);
+        if (auto tail = begin + kHugePageSize - aligned) munmap(reinterpret_cast<void*>(aligned + tLen), tail);
+        #ifdef MADV_HUGEPAGE
+        madvise(reinterpret_cast<void*>(aligned), tLen, MADV_HUGEPAGE);
+        #endif
+        return reinterpret_cast<void*>(aligned);
+    }
+
+    static void unmap(void* tAddr, size_t tLen) {
+        munmap(tAddr, tLen);
+    }
+
+    // touches every page for writing, so later accesses don't fault
+    static void prefault(void* tAddr, size_t tLen) {
+        #ifdef MADV_POPULATE_WRITE
+        if (madvise(tAddr, tLen, MADV_POPULATE_WRITE) == 0) return;
+        #endif
+        auto bytes = static_cast<volatile char*>(tAddr);
+        for (size_t i = 0; i < tLen; i += pageSize()) bytes[i] = bytes[i];
+    }
+
+    // reads every page of a range in (e.g. of a file mapping), so later reads don't fault on the disk
+    static void populate(const void* tAddr, size_t tLen) {
+        if (tLen == 0) return;
+        auto [begin, len] = pages(tAddr, tLen);
+        #ifdef MADV_POPULATE_READ
+        if (madvise(reinterpret_cast<void*>(begin), len, MADV_POPULATE_READ) == 0) return;
+        #endif
+        auto bytes = reinterpret_cast<const volatile char*>(begin);
+        for (size_t i = 0; i < len; i += pageSize()) static_cast<void>(bytes[i]);
+    }
+
+    // drops the pages completely inside a range (anonymous memory reads as zero again, mapped files are re-read)
+    static void discard(const void* tAddr, size_t tLen) {
+        auto mask = pageSize() - 1;
+        auto begin = (reinterpret_cast<uintptr_t>(tAddr) + mask) & ~mask;
+        auto end = (reinterpret_cast<uintptr_t>(tAddr) + tLen) & ~mask;
+        if (end > begin) madvise(reinterpret_cast<void*>(begin), end - begin, MADV_DONTNEED);
+    }
+
+    // keeps the pages of a range in RAM (faulting them in), false if the lock limit is reached;
+    // once the limit is reached, locks are tried again after others were undone, and never again without
+    // permission to lock (until retryLock finds RLIMIT_MEMLOCK changed)
+    static bool lock(const void* tAddr, size_t tLen) {
+        if (tLen == 0) return true;
+        if (sLockDisabled.load(std::memory_order_relaxed)) return false;
+        if (lockedBytes() >= sLockFullAt.load(std::memory_order_relaxed)) return false;
+        auto [begin, len] = pages(tAddr, tLen);
+        if (mlock(reinterpret_cast<void*>(begin), len) != 0) {
+            auto error = errno;
+            if (error == EPERM) {
+                sLockLimit = lockLimit();
+                if (!sLockDisabled.exchange(true)) log.warn() << "MemoryPages mlock failed (" << strerror(error) << ") - locking disabled until RLIMIT_MEMLOCK changes";
+            } else if (error == ENOMEM) {
+                sLockFullAt = lockedBytes();
+                if (!sLockFullLogged.exchange(true)) log.warn() << "MemoryPages mlock failed (" << strerror(error) << ") - RLIMIT_MEMLOCK reached, locking resumes as locked windows move on";
+            }
+            return false;
+        }
+        sLockFullAt = SIZE_MAX;
+        sLockedBytes.fetch_add(len, std::memory_order_relaxed);
+        return true;
+    }
+
+    // undoes a successful lock of the same range
+    static void unlock(const void* tAddr, size_t tLen) {
+        if (tLen == 0) return;
+        auto [begin, len] = pages(tAddr, tLen);
+        munlock(reinterpret_cast<void*>(begin), len);
+        sLockedBytes.fetch_sub(len, std::memory_order_relaxed);
+    }
+
+    // enables locking again if RLIMIT_MEMLOCK changed since it was refused (cheap, called once per engine tick)
+    static void retryLock() {
+        if (!sLockDisabled.load(std::memory_order_relaxed) || lockLimit() == sLockLimit) return;
+        sLockDisabled = false;
+        sLockFullAt = SIZE_MAX;
+        log.info() << "MemoryPages RLIMIT_MEMLOCK changed - locking enabled again";
+    }
+
+    static size_t lockedBytes() {
+        return sLockedBytes.load(std::memory_order_relaxed);
+    }
+
+    static HugePages parseHugePages(int tValue) {
+        return static_cast<HugePages>(std::clamp(tValue, static_cast<int>(HUGE_OFF), static_cast<int>(HUGE_EXPLICIT)));
+    }
+};
+
+}
+}
@@ -0,0 +1,124 @@
+/*
+ *  Copyright (C) 2024-2025 Christoph Pastl
+ *
+ *  This file is part of Castor.
+ *
+ *  Castor is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Castor is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ *  If you use this program over a network, you must also offer access
+ *  to the source code under the terms of the GNU Lesser General Public License.
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+
+namespace castor {
+namespace util {
+
+// Fixed-size array of raw pointers published RCU-style to a single realtime reader.
+// The reader never allocates, locks or touches refcounts; writers (serialized externally)
+// fill the inactive slot, publish it and wait for the reader to leave the old one.
+template <typename T, size_t N>
+class RCUArray {
+public:
+    struct Snapshot {
+        std::array<T*, N> items{};
+        size_t size = 0;
+
+        T* const* begin() const { return items.data(); }
+        T* const* end() const { return items.data() + size; }
+    };
+
+    class ReadGuard {
+        RCUArray& mArray;
+        const Snapshot& mSnapshot;
+
+    public:
+        ReadGuard(RCUArray& tArray) :
+            mArray(tArray),
+            mSnapshot(tArray.readLock())
+        {}
+
+        ~ReadGuard() {
+            mArray.readUnlock();
+        }
+
+        ReadGuard(const ReadGuard&) = delete;
+        ReadGuard& operator=(const ReadGuard&) = delete;
+
+        T* const* begin() const { return mSnapshot.begin(); }
+        T* const* end() const { return mSnapshot.end(); }
+        size_t size() const { return mSnapshot.size; }
+    };
+
+private:
+    static constexpr auto kGracePollInterval = std::chrono::microseconds(100);
+
+    std::array<Snapshot, 2> mSnapshots{};
+    std::atomic<size_t> mPublished = 0;
+    std::atomic<uint64_t> mReaderEpoch = 0; // odd while the reader is inside a read section
+
+    const Snapshot& readLock() {
+        mReaderEpoch.fetch_add(1, std::memory_order_seq_cst);
+        return mSnapshots[mPublished.load(std::memory_order_seq_cst)];
+    }
+
+    void readUnlock() {
+        mReaderEpoch.fetch_add(1, std::memory_order_release);
+    }
+
+public:
+    static constexpr size_t capacity() { return N; }
+
+    // realtime reader
+
+    ReadGuard read() {
+        return ReadGuard(*this);
+    }
+
+    // writer
+
+    // publishes raw pointers of a range of (smart) pointers and returns the number of published items
+    template <typename Range>
+    size_t publish(const Range& tItems) {
+        auto next = mPublished.load(std::memory_order_relaxed) ^ 1;
+        auto& snapshot = mSnapshots[next];
+        size_t size = 0;
+        for (const auto& item : tItems) {
+            if (size == N) break;
+            snapshot.items[size++] = std::to_address(item);
+        }
+        snapshot.size = size;
+        mPublished.store(next, std::memory_order_seq_cst);
+        synchronize();
+        return size;
+    }
+
+    // waits until the reader has left any section that may still see the previous snapshot
+    void synchronize() {
+        auto epoch = mReaderEpoch.load(std::memory_order_seq_cst);
+        if ((epoch & 1) == 0) return;
+        while (mReaderEpoch.load(std::memory_order_acquire) == epoch) {
+            std::this_thread::sleep_for(kGracePollInterval);
+        }
+    }
+};
+
+}
+}
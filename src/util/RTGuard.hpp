@@ -0,0 +1,347 @@
+/*
+ *  Copyright (C) 2024-2025 Christoph Pastl
+ *
+ *  This file is part of Castor.
+ *
+ *  Castor is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Castor is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ *  If you use this program over a network, you must also offer access
+ *  to the source code under the terms of the GNU Lesser General Public License.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <json.hpp>
+#include "Log.hpp"
+
+#if defined(CASTOR_RT_GUARD)
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <new>
+#endif
+
+namespace castor {
+namespace util {
+
+// Opt-in real-time safety guard (build with -DCASTOR_RT_GUARD=ON).
+// Threads inside a realtime Scope (the audio callback) are watched for allocations, mutex and
+// condition variable operations, sleeps and blocking i/o. Each violation is hashed by its call
+// stack and counted in a fixed, lock-free table, which is logged and exported from a non-realtime
+// thread. Outside a Scope, intercepted calls cost a thread-local load; without the build flag
+// the guard compiles to nothing.
+class RTGuard {
+public:
+    enum Violation : uint8_t {
+        ALLOC,
+        FREE,
+        MUTEX,
+        CONDITION,
+        SLEEP,
+        IO,
+        kNumViolations
+    };
+
+    static constexpr const char* kViolationNames[kNumViolations] = {
+        "alloc", "free", "mutex", "condition", "sleep", "io"
+    };
+
+    #if defined(CASTOR_RT_GUARD)
+    static constexpr bool kEnabled = true;
+    #else
+    static constexpr bool kEnabled = false;
+    #endif
+
+    // marks the current thread as realtime for its lifetime
+    class Scope {
+        const bool mOuter;
+
+    public:
+        Scope() : mOuter(sRealtime) { sRealtime = kEnabled; }
+        ~Scope() { sRealtime = mOuter; }
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+    };
+
+private:
+    static constexpr size_t kMaxFrames = 12;
+    static constexpr size_t kSkipFrames = 2; // record() and the interceptor
+    static constexpr size_t kNumRecords = 256;
+
+    // zero-initialized as static storage
+    struct Record {
+        std::atomic<uint64_t> hash;
+        std::atomic<uint64_t> count;
+        std::atomic<bool> ready;
+        std::atomic<bool> reported;
+        Violation violation;
+        int depth;
+        std::array<void*, kMaxFrames> frames;
+    };
+
+    static inline thread_local bool sRealtime = false;
+    static inline thread_local bool sRecording = false;
+    static inline std::array<Record, kNumRecords> sRecords;
+    static inline std::atomic<uint64_t> sViolations = 0;
+    static inline std::atomic<uint64_t> sDropped = 0;
+
+    static uint64_t hashFrames(void* const* tFrames, int tDepth, Violation tViolation) {
+        uint64_t hash = 1469598103934665603ull ^ tViolation; // FNV-1a
+        for (int i = 0; i < tDepth; ++i) {
+            hash ^= reinterpret_cast<uintptr_t>(tFrames[i]);
+            hash *= 1099511628211ull;
+        }
+        return hash ? hash : 1;
+    }
+
+public:
+    static bool isRealtime() { return sRealtime; }
+
+    // called by the interceptors; lock- and allocation-free after install()
+    static void record(Violation tViolation) noexcept {
+        if (!sRealtime || sRecording) return;
+        sRecording = true;
+        sViolations.fetch_add(1, std::memory_order_relaxed);
+
+        std::array<void*, kMaxFrames + kSkipFrames> frames;
+        int depth = 0;
+        #if defined(CASTOR_RT_GUARD)
+        depth = std::max(backtrace(frames.data(), int(frames.size())) - int(kSkipFrames), 0);
+        #endif
+        auto stack = frames.data() + kSkipFrames;
+        auto hash = hashFrames(stack, depth, tViolation);
+
+        for (size_t i = 0; i < kNumRecords; ++i) {
+            auto& rec = sRecords[(hash + i) % kNumRecords];
+            auto slotHash = rec.hash.load(std::memory_order_acquire);
+            if (slotHash == 0 && rec.hash.compare_exchange_strong(slotHash, hash, std::memory_order_acq_rel)) {
+                rec.violation = tViolation;
+                rec.depth = depth;
+                std::copy(stack, stack + depth, rec.frames.begin());
+                rec.ready.store(true, std::memory_order_release);
+                slotHash = hash;
+            }
+            if (slotHash == hash) {
+                rec.count.fetch_add(1, std::memory_order_relaxed);
+                sRecording = false;
+                return;
+            }
+        }
+        sDropped.fetch_add(1, std::memory_order_relaxed);
+        sRecording = false;
+    }
+
+    // resolves the unwinder up front, so the first violation does not load it on the realtime thread
+    static void install() {
+        if (!kEnabled) return;
+        #if defined(CASTOR_RT_GUARD)
+        std::array<void*, kMaxFrames> frames;
+        backtrace(frames.data(), int(frames.size()));
+        #endif
+        log.warn() << "RTGuard enabled - watching realtime threads for blocking calls";
+    }
+
+    static uint64_t violations() { return sViolations.load(std::memory_order_relaxed); }
+
+    // logs violations seen for the first time (non-realtime threads)
+    static void report() {
+        for (auto& rec : sRecords) {
+            if (!rec.ready.load(std::memory_order_acquire) || rec.reported.exchange(true)) continue;
+            std::ostringstream stack;
+            #if defined(CASTOR_RT_GUARD)
+            auto symbols = backtrace_symbols(rec.frames.data(), rec.depth);
+            for (int i = 0; symbols && i < rec.depth; ++i) stack << "\n    " << symbols[i];
+            free(symbols);
+            #endif
+            log.error() << "RTGuard " << kViolationNames[rec.violation] << " on realtime thread (stack " << std::hex << rec.hash.load() << std::dec << ")" << stack.str();
+        }
+    }
+
+    static nlohmann::json getJSON() {
+        nlohmann::json records = nlohmann::json::array();
+        for (const auto& rec : sRecords) {
+            if (!rec.ready.load(std::memory_order_acquire)) continue;
+            std::ostringstream hash;
+            hash << std::hex << rec.hash.load(std::memory_order_relaxed);
+            records.push_back({
+                {"violation", kViolationNames[rec.violation]},
+                {"stack", hash.str()},
+                {"count", rec.count.load(std::memory_order_relaxed)}
+            });
+        }
+        return {
+            {"enabled", kEnabled},
+            {"violations", violations()},
+            {"dropped", sDropped.load(std::memory_order_relaxed)},
+            {"records", records}
+        };
+    }
+};
+
+}
+}
+
+#if defined(CASTOR_RT_GUARD)
+
+// Interceptors, defined once in the single translation unit (main.cc).
+// Allocations are caught at malloc level on glibc (operator new allocates through it) and at
+// operator new/delete level elsewhere; locks, waits, sleeps and i/o are interposed on Linux only.
+
+#if defined(__GLIBC__)
+
+extern "C" {
+void* __libc_malloc(size_t);
+void* __libc_calloc(size_t, size_t);
+void* __libc_realloc(void*, size_t);
+void __libc_free(void*);
+
+// noexcept like glibc's own declarations (__THROW), which may be seen before or after these
+
+void* malloc(size_t tSize) noexcept {
+    castor::util::RTGuard::record(castor::util::RTGuard::ALLOC);
+    return __libc_malloc(tSize);
+}
+
+void* calloc(size_t tCount, size_t tSize) noexcept {
+    castor::util::RTGuard::record(castor::util::RTGuard::ALLOC);
+    return __libc_calloc(tCount, tSize);
+}
+
+void* realloc(void* tPtr, size_t tSize) noexcept {
+    castor::util::RTGuard::record(castor::util::RTGuard::ALLOC);
+    return __libc_realloc(tPtr, tSize);
+}
+
+void free(void* tPtr) noexcept {
+    if (tPtr) castor::util::RTGuard::record(castor::util::RTGuard::FREE);
+    __libc_free(tPtr);
+}
+}
+
+#else
+
+void* operator new(size_t tSize) {
+    castor::util::RTGuard::record(castor::util::RTGuard::ALLOC);
+    if (auto ptr = std::malloc(tSize ? tSize : 1)) return ptr;
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t tSize) {
+    return operator new(tSize);
+}
+
+void operator delete(void* tPtr) noexcept {
+    if (tPtr) castor::util::RTGuard::record(castor::util::RTGuard::FREE);
+    std::free(tPtr);
+}
+
+void operator delete[](void* tPtr) noexcept {
+    operator delete(tPtr);
+}
+
+void operator delete(void* tPtr, size_t) noexcept {
+    operator delete(tPtr);
+}
+
+void operator delete[](void* tPtr, size_t) noexcept {
+    operator delete(tPtr);
+}
+
+#endif
+
+#if defined(__linux__)
+
+// resolves the next definition of an interposed symbol; racing first calls store the same pointer
+#define CASTOR_RT_GUARD_NEXT(name) \
+    static std::atomic<decltype(&name)> sNext{nullptr}; \
+    auto next = sNext.load(std::memory_order_relaxed); \
+    if (!next) sNext.store(next = reinterpret_cast<decltype(&name)>(dlsym(RTLD_NEXT, #name)), std::memory_order_relaxed)
+
+extern "C" {
+int pthread_mutex_lock(pthread_mutex_t* tMutex) {
+    castor::util::RTGuard::record(castor::util::RTGuard::MUTEX);
+    CASTOR_RT_GUARD_NEXT(pthread_mutex_lock);
+    return next(tMutex);
+}
+
+int pthread_cond_wait(pthread_cond_t* tCond, pthread_mutex_t* tMutex) {
+    castor::util::RTGuard::record(castor::util::RTGuard::CONDITION);
+    CASTOR_RT_GUARD_NEXT(pthread_cond_wait);
+    return next(tCond, tMutex);
+}
+
+int pthread_cond_timedwait(pthread_cond_t* tCond, pthread_mutex_t* tMutex, const struct timespec* tTime) {
+    castor::util::RTGuard::record(castor::util::RTGuard::CONDITION);
+    CASTOR_RT_GUARD_NEXT(pthread_cond_timedwait);
+    return next(tCond, tMutex, tTime);
+}
+
+#if __GLIBC_PREREQ(2, 30)
+int pthread_cond_clockwait(pthread_cond_t* tCond, pthread_mutex_t* tMutex, clockid_t tClock, const struct timespec* tTime) {
+    castor::util::RTGuard::record(castor::util::RTGuard::CONDITION);
+    CASTOR_RT_GUARD_NEXT(pthread_cond_clockwait);
+    return next(tCond, tMutex, tClock, tTime);
+}
+#endif
+
+int pthread_cond_signal(pthread_cond_t* tCond) {
+    castor::util::RTGuard::record(castor::util::RTGuard::CONDITION);
+    CASTOR_RT_GUARD_NEXT(pthread_cond_signal);
+    return next(tCond);
+}
+
+int pthread_cond_broadcast(pthread_cond_t* tCond) {
+    castor::util::RTGuard::record(castor::util::RTGuard::CONDITION);
+    CASTOR_RT_GUARD_NEXT(pthread_cond_broadcast);
+    return next(tCond);
+}
+
+int nanosleep(const struct timespec* tRequest, struct timespec* tRemain) {
+    castor::util::RTGuard::record(castor::util::RTGuard::SLEEP);
+    CASTOR_RT_GUARD_NEXT(nanosleep);
+    return next(tRequest, tRemain);
+}
+
+int usleep(useconds_t tDuration) {
+    castor::util::RTGuard::record(castor::util::RTGuard::SLEEP);
+    CASTOR_RT_GUARD_NEXT(usleep);
+    return next(tDuration);
+}
+
+ssize_t read(int tFd, void* tBuf, size_t tCount) {
+    castor::util::RTGuard::record(castor::util::RTGuard::IO);
+    CASTOR_RT_GUARD_NEXT(read);
+    return next(tFd, tBuf, tCount);
+}
+
+ssize_t write(int tFd, const void* tBuf, size_t tCount) {
+    castor::util::RTGuard::record(castor::util::RTGuard::IO);
+    CASTOR_RT_GUARD_NEXT(write);
+    return next(tFd, tBuf, tCount);
+}
+}
+
+#undef CASTOR_RT_GUARD_NEXT
+
+#endif
+
+#endif
@@ -0,0 +1,125 @@
+/*
+ *  Copyright (C) 2024-2025 Christoph Pastl
+ *
+ *  This file is part of Castor.
+ *
+ *  Castor is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Castor is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ *  If you use this program over a network, you must also offer access
+ *  to the source code under the terms of the GNU Lesser General Public License.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <pthread.h>
+#include "Log.hpp"
+
+namespace castor {
+namespace util {
+
+// Destroys retired objects (players, buffers, codec readers) on a low-priority background thread,
+// so that joining threads and freeing large allocations never happens on a time-critical thread.
+class Reclaimer {
+
+    struct Item {
+        std::shared_ptr<void> object;
+        size_t bytes;
+    };
+
+    std::atomic<bool> mRunning = true;
+    std::atomic<size_t> mPendingCount = 0;
+    std::atomic<size_t> mPendingBytes = 0;
+    std::atomic<size_t> mRetiredCount = 0;
+    std::atomic<size_t> mRetiredBytes = 0;
+    std::mutex mMutex;
+    std::condition_variable mCV;
+    std::deque<Item> mItems;
+    std::thread mWorker;
+
+public:
+    Reclaimer() :
+        mWorker(&Reclaimer::run, this)
+    {}
+
+    ~Reclaimer() {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mRunning = false;
+        }
+        mCV.notify_all();
+        if (mWorker.joinable()) mWorker.join();
+    }
+
+    template <typename T>
+    void retire(std::shared_ptr<T> tObject, size_t tBytes = 0) {
+        if (!tObject) return;
+        mPendingCount.fetch_add(1, std::memory_order_relaxed);
+        mPendingBytes.fetch_add(tBytes, std::memory_order_relaxed);
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mItems.push_back({std::move(tObject), tBytes});
+        }
+        mCV.notify_one();
+    }
+
+    template <typename T>
+    void retire(std::unique_ptr<T> tObject, size_t tBytes = 0) {
+        retire(std::shared_ptr<T>(std::move(tObject)), tBytes);
+    }
+
+    size_t pendingCount() const { return mPendingCount.load(std::memory_order_relaxed); }
+    size_t pendingBytes() const { return mPendingBytes.load(std::memory_order_relaxed); }
+    size_t retiredCount() const { return mRetiredCount.load(std::memory_order_relaxed); }
+    size_t retiredBytes() const { return mRetiredBytes.load(std::memory_order_relaxed); }
+
+private:
+    static void lowerPriority() {
+        #if defined(__APPLE__)
+        pthread_set_qos_class_self_np(QOS_CLASS_BACKGROUND, 0);
+        #elif defined(__linux__)
+        sched_param param{};
+        if (pthread_setschedparam(pthread_self(), SCHED_IDLE, &param) != 0) {
+            log.debug() << "Reclaimer failed to set idle scheduling policy";
+        }
+        #endif
+    }
+
+    void run() {
+        lowerPriority();
+        while (true) {
+            Item item;
+            {
+                std::unique_lock<std::mutex> lock(mMutex);
+                mCV.wait(lock, [this] { return mItems.size() || !mRunning; });
+                if (mItems.empty()) return; // drained and stopped
+                item = std::move(mItems.front());
+                mItems.pop_front();
+            }
+            item.object.reset();
+            mPendingCount.fetch_sub(1, std::memory_order_relaxed);
+            mPendingBytes.fetch_sub(item.bytes, std::memory_order_relaxed);
+            mRetiredCount.fetch_add(1, std::memory_order_relaxed);
+            mRetiredBytes.fetch_add(item.bytes, std::memory_order_relaxed);
+        }
+    }
+};
+
+}
+}
@@ -0,0 +1,136 @@
+/*
+ *  Copyright (C) 2024-2025 Christoph Pastl
+ *
+ *  This file is part of Castor.
+ *
+ *  Castor is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Castor is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ *  If you use this program over a network, you must also offer access
+ *  to the source code under the terms of the GNU Lesser General Public License.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+namespace castor {
+namespace util {
+
+// Lock-free single-producer/single-consumer ring of trivially copyable elements.
+// Capacity is rounded up to a power of two; the producer and consumer may live on any two threads.
+template <typename T>
+class SPSCRing {
+    static_assert(std::is_trivially_copyable_v<T>, "SPSCRing requires trivially copyable elements");
+
+    const size_t mCapacity;
+    const size_t mMask;
+    std::vector<T> mBuffer;
+    alignas(64) std::atomic<size_t> mHead = 0; // consumer position
+    alignas(64) std::atomic<size_t> mTail = 0; // producer position
+
+public:
+    SPSCRing(size_t tCapacity) :
+        mCapacity(std::bit_ceil(std::max<size_t>(tCapacity, 1))),
+        mMask(mCapacity - 1),
+        mBuffer(mCapacity)
+    {}
+
+    size_t capacity() const { return mCapacity; }
+
+    size_t size() const {
+        return mTail.load(std::memory_order_acquire) - mHead.load(std::memory_order_acquire);
+    }
+
+    size_t writable() const {
+        return mCapacity - size();
+    }
+
+    bool empty() const {
+        return size() == 0;
+    }
+
+
+    // producer
+
+    // writes all or nothing, returns the number of elements written
+    size_t write(const T* tData, size_t tLen) {
+        auto tail = mTail.load(std::memory_order_relaxed);
+        if (tLen > mCapacity - (tail - mHead.load(std::memory_order_acquire))) return 0;
+        auto pos = tail & mMask;
+        auto first = std::min(tLen, mCapacity - pos);
+        memcpy(&mBuffer[pos], tData, first * sizeof(T));
+        memcpy(&mBuffer[0], tData + first, (tLen - first) * sizeof(T));
+        mTail.store(tail + tLen, std::memory_order_release);
+        return tLen;
+    }
+
+    bool push(const T& tItem) {
+        return write(&tItem, 1) == 1;
+    }
+
+
+    // consumer
+
+    // calls tFunc(const T* data, size_t len) for up to two contiguous spans of the first tLen readable elements
+    // without consuming them, returns the number of elements visited
+    template <typename Func>
+    size_t peek(size_t tLen, Func&& tFunc) const {
+        auto head = mHead.load(std::memory_order_relaxed);
+        tLen = std::min(tLen, mTail.load(std::memory_order_acquire) - head);
+        auto pos = head & mMask;
+        auto first = std::min(tLen, mCapacity - pos);
+        if (first) tFunc(&mBuffer[pos], first);
+        if (tLen > first) tFunc(&mBuffer[0], tLen - first);
+        return tLen;
+    }
+
+    const T* front() const {
+        auto head = mHead.load(std::memory_order_relaxed);
+        if (head == mTail.load(std::memory_order_acquire)) return nullptr;
+        return &mBuffer[head & mMask];
+    }
+
+    void consume(size_t tLen) {
+        auto head = mHead.load(std::memory_order_relaxed);
+        tLen = std::min(tLen, mTail.load(std::memory_order_acquire) - head);
+        mHead.store(head + tLen, std::memory_order_release);
+    }
+
+    size_t read(T* tData, size_t tLen) {
+        size_t offset = 0;
+        auto len = peek(tLen, [&](const T* data, size_t n) {
+            memcpy(tData + offset, data, n * sizeof(T));
+            offset += n;
+        });
+        consume(len);
+        return len;
+    }
+
+    bool pop(T& tItem) {
+        return read(&tItem, 1) == 1;
+    }
+
+    // drops all readable elements
+    void clear() {
+        mHead.store(mTail.load(std::memory_order_acquire), std::memory_order_release);
+    }
+};
+
+}
+}
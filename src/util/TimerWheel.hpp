@@ -0,0 +1,212 @@
+/*
+ *  Copyright (C) 2024-2025 Christoph Pastl
+ *
+ *  This file is part of Castor.
+ *
+ *  Castor is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Castor is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ *  If you use this program over a network, you must also offer access
+ *  to the source code under the terms of the GNU Lesser General Public License.
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include "EngineClock.hpp"
+#include "Log.hpp"
+
+namespace castor {
+namespace util {
+
+// Hierarchical timer wheel driving timed callbacks from a single thread.
+// Level 0 has 256 slots of one tick, each further level 64 slots covering the whole range of the level below
+// (10 ms ticks: 2.56 s, 2.7 min, 2.9 h, 7.8 days). Timers are cascaded down a level when their slot comes up.
+// Scheduling and cancelling are O(1); callbacks run on the wheel thread and must not block for long.
+class TimerWheel {
+public:
+    using Id = uint64_t;
+    using Clock = std::chrono::system_clock;
+
+private:
+    static constexpr size_t kLevels = 4;
+    static constexpr size_t kRootBits = 8;
+    static constexpr size_t kLevelBits = 6;
+    static constexpr size_t kRootSize = 1 << kRootBits;
+    static constexpr size_t kLevelSize = 1 << kLevelBits;
+
+    struct Timer {
+        Id id;
+        uint64_t tick;
+        std::function<void()> callback;
+    };
+
+    using Slot = std::list<Timer>;
+
+    struct Location {
+        Slot* slot;
+        Slot::iterator it;
+    };
+
+    const Clock::duration mResolution;
+    const Clock::time_point mOrigin;
+    std::array<Slot, kRootSize> mRoot;
+    std::array<std::array<Slot, kLevelSize>, kLevels - 1> mLevels;
+    std::unordered_map<Id, Location> mTimers;
+    uint64_t mTick = 0;
+    Id mNextId = 1;
+    Id mRunningId = 0;
+    std::atomic<bool> mRunning = true;
+    std::mutex mMutex;
+    std::condition_variable mRunningCV;
+    std::thread mWorker;
+
+public:
+    TimerWheel(Clock::duration tResolution = std::chrono::milliseconds(10)) :
+        mResolution(tResolution),
+        mOrigin(EngineClock::now()),
+        mWorker(&TimerWheel::run, this)
+    {}
+
+    ~TimerWheel() {
+        mRunning = false;
+        if (mWorker.joinable()) mWorker.join();
+    }
+
+    // runs tCallback on the wheel thread at tTime (or on the next tick if it has passed), returns a handle for cancel()
+    Id schedule(Clock::time_point tTime, std::function<void()> tCallback) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        auto id = mNextId++;
+        auto tick = std::max(tickAt(tTime + mResolution - Clock::duration(1)), mTick + 1); // round up, never fire early
+        insert({id, tick, std::move(tCallback)});
+        return id;
+    }
+
+    // removes a pending timer; if its callback is running on another thread, waits until it has returned
+    bool cancel(Id tId) {
+        if (tId == 0) return false;
+        std::unique_lock<std::mutex> lock(mMutex);
+        auto it = mTimers.find(tId);
+        if (it != mTimers.end()) {
+            it->second.slot->erase(it->second.it);
+            mTimers.erase(it);
+            return true;
+        }
+        if (std::this_thread::get_id() != mWorker.get_id()) {
+            mRunningCV.wait(lock, [&] { return mRunningId != tId; });
+        }
+        return false;
+    }
+
+    size_t size() {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mTimers.size();
+    }
+
+    // true once all timers due up to the current engine time have run
+    bool isCurrent() {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mRunningId == 0 && mTick >= tickAt(EngineClock::now());
+    }
+
+private:
+    uint64_t tickAt(Clock::time_point tTime) const {
+        if (tTime <= mOrigin) return 0;
+        return (tTime - mOrigin) / mResolution;
+    }
+
+    Slot& slotFor(uint64_t tTick) {
+        auto delta = tTick - mTick;
+        if (delta < kRootSize) return mRoot[tTick & (kRootSize - 1)];
+        for (size_t level = 0; level < kLevels - 1; ++level) {
+            auto shift = kRootBits + level * kLevelBits;
+            if (delta < (uint64_t(1) << (shift + kLevelBits)) || level == kLevels - 2) {
+                // timers beyond the range wait in the last slot reachable and get re-cascaded
+                if (delta >= (uint64_t(1) << (shift + kLevelBits))) tTick = mTick + (uint64_t(1) << (shift + kLevelBits)) - 1;
+                return mLevels[level][(tTick >> shift) & (kLevelSize - 1)];
+            }
+        }
+        return mRoot[tTick & (kRootSize - 1)]; // unreachable
+    }
+
+    void insert(Timer&& tTimer, Slot* tFrom = nullptr, Slot::iterator tIt = {}) {
+        auto id = tTimer.id;
+        auto& slot = slotFor(tTimer.tick);
+        if (tFrom) {
+            slot.splice(slot.end(), *tFrom, tIt);
+        } else {
+            slot.push_back(std::move(tTimer));
+        }
+        mTimers[id] = {&slot, std::prev(slot.end())};
+    }
+
+    // moves the timers of the current slot of a higher level down
+    void cascade(size_t tLevel) {
+        auto shift = kRootBits + tLevel * kLevelBits;
+        auto& slot = mLevels[tLevel][(mTick >> shift) & (kLevelSize - 1)];
+        while (!slot.empty()) {
+            auto it = slot.begin();
+            insert(std::move(*it), &slot, it);
+        }
+    }
+
+    void advance() {
+        ++mTick;
+        // cascade from the highest level whose slot boundary is crossed, so timers can fall through several levels
+        size_t levels = 0;
+        while (levels < kLevels - 1 && (mTick & ((uint64_t(1) << (kRootBits + levels * kLevelBits)) - 1)) == 0) ++levels;
+        while (levels > 0) cascade(--levels);
+    }
+
+    void run() {
+        std::unique_lock<std::mutex> lock(mMutex);
+        while (mRunning) {
+            auto target = tickAt(EngineClock::now());
+            while (mTick < target && mRunning) {
+                advance();
+                auto& slot = mRoot[mTick & (kRootSize - 1)];
+                while (!slot.empty()) {
+                    auto timer = std::move(slot.front());
+                    slot.pop_front();
+                    mTimers.erase(timer.id);
+                    mRunningId = timer.id;
+                    lock.unlock();
+                    try {
+                        timer.callback();
+                    }
+                    catch (const std::exception& e) {
+                        log.error() << "TimerWheel callback failed: " << e.what();
+                    }
+                    timer.callback = nullptr; // release captures outside the lock
+                    lock.lock();
+                    mRunningId = 0;
+                    mRunningCV.notify_all();
+                }
+            }
+            lock.unlock();
+            EngineClock::sleepUntil(mOrigin + (mTick + 1) * mResolution);
+            lock.lock();
+        }
+    }
+};
+
+}
+}
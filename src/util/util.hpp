@@ -24,6 +24,7 @@
 
 #include <atomic>
 #include <chrono>
+#include <fstream>
 #include <functional>
 #include <iostream>
 #include <string>
@@ -37,6 +38,7 @@
 #include <cstring>
 #include <cmath>
 #include <queue>
+#include "EngineClock.hpp"
 
 namespace castor {
 namespace util {
@@ -59,10 +61,10 @@ std::string timefmt(const time_t& tTime, const char* tFormat) {
 }
 
 std::string fileTimestamp() {
-    return timefmt(std::time(0), "%Y-%m-%dT%H-%M-%S");
+    return timefmt(EngineClock::time(), "%Y-%m-%dT%H-%M-%S");
 }
 
-std::string utcFmt(const time_t& tTime = std::time(0)) {
+std::string utcFmt(const time_t& tTime = EngineClock::time()) {
     static constexpr const char* fmt = "%Y-%m-%dT%H:%M:%S";
     return timefmt(tTime, fmt);
 }
@@ -230,7 +232,7 @@ public:
     {}
 
     bool query() {
-        auto now = std::time(0);
+        auto now = EngineClock::time();
         if (now - mLastQuery > mTimeout) {
             mLastQuery = now;
             return true;
@@ -276,7 +278,7 @@ private:
         while (mRunning.load()) {
             {
                 std::unique_lock<std::mutex> lock(mMutex);
-                if (mCV.wait_for(lock, mInterval, [this]{ return !mRunning.load(std::memory_order_acquire); })) return;
+                if (EngineClock::waitFor(mCV, lock, mInterval, [this]{ return !mRunning.load(std::memory_order_acquire); })) return;
             }
             if (callback) callback();
         }
@@ -292,7 +294,7 @@ public:
 
 private:
     std::chrono::system_clock::time_point nextAlignedTime() const {
-        auto now = std::chrono::system_clock::now();
+        auto now = EngineClock::now();
         auto now_time_t = std::chrono::system_clock::to_time_t(now);
         auto tm = std::localtime(&now_time_t);
         auto passedSec = tm->tm_min * 60 + tm->tm_sec;
@@ -309,7 +311,7 @@ private:
             auto nextTimePt = nextAlignedTime();
             {
                 std::unique_lock<std::mutex> lock(mMutex);
-                if (mCV.wait_until(lock, nextTimePt, [this]{ return !mRunning.load(std::memory_order_acquire); })) return;
+                if (EngineClock::waitUntil(mCV, lock, nextTimePt, [this]{ return !mRunning.load(std::memory_order_acquire); })) return;
             }
             if (callback) callback();
         }
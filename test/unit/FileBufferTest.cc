@@ -0,0 +1,122 @@
+/*
+ *  Copyright (C) 2024-2025 Christoph Pastl
+ *
+ *  This file is part of Castor.
+ *
+ *  Castor is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Castor is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ *  If you use this program over a network, you must also offer access
+ *  to the source code under the terms of the GNU Lesser General Public License.
+ */
+
+
+// FileBuffer reads, mixes and copies across chunk boundaries, in full and compact storage,
+// and grows past the capacity hint of the decoder.
+
+#include <cmath>
+#include <memory>
+#include <vector>
+#include "api/API.hpp" // PlayItem, included ahead of the players as in Castor.hpp
+#include "dsp/FilePlayer.hpp"
+#include "check.hpp"
+
+using namespace castor;
+using namespace castor::audio;
+
+static constexpr size_t kChannels = 2;
+
+static sam_t sampleAt(size_t tPos) {
+    return static_cast<sam_t>(tPos % 997) / 997.0f - 0.5f;
+}
+
+// writes tLen samples in uneven blocks, through writeSpan where the buffer offers it
+static void fill(FileBuffer<sam_t>& tBuffer, size_t tLen, bool tSpans) {
+    std::vector<sam_t> block(4093);
+    size_t pos = 0;
+    while (pos < tLen) {
+        auto len = std::min(block.size(), tLen - pos);
+        if (auto span = tSpans ? tBuffer.writeSpan(len) : std::span<sam_t>{}; !span.empty()) {
+            for (size_t i = 0; i < span.size(); ++i) span[i] = sampleAt(pos + i);
+            tBuffer.commitWrite(span.size());
+            pos += span.size();
+        } else {
+            for (size_t i = 0; i < len; ++i) block[i] = sampleAt(pos + i);
+            CHECK(tBuffer.write(block.data(), len) == len);
+            pos += len;
+        }
+    }
+    tBuffer.finish();
+}
+
+static void testBuffer(bool tCompact, bool tSpans) {
+    std::printf("testing %s storage%s\n", tCompact ? "compact" : "full", tSpans ? " (spans)" : "");
+    auto pool = std::make_shared<util::ChunkPool>(4);
+    auto chunkSamples = util::ChunkPool::kChunkSize / (tCompact ? sizeof(int16_t) : sizeof(sam_t));
+    auto length = chunkSamples * 5 / 2 + 3 * kChannels; // ends within a third chunk
+    auto tolerance = tCompact ? 1.0f / kernels::kInt16Scale : 0.0f;
+
+    // the duration reported by a container is only a hint
+    FileBuffer<sam_t> buffer(tCompact, pool);
+    buffer.resize(1000);
+    fill(buffer, length, tSpans);
+    CHECK(buffer.writePosition() == length);
+    CHECK(buffer.capacity() == length);
+    CHECK(buffer.memorySize() == 3 * util::ChunkPool::kChunkSize);
+
+    // reads in blocks that straddle the chunk boundaries
+    std::vector<sam_t> block(4099 * kChannels);
+    size_t pos = 0;
+    while (auto len = buffer.read(block.data(), block.size())) {
+        for (size_t i = 0; i < len; ++i) CHECK(std::fabs(block[i] - sampleAt(pos + i)) <= tolerance);
+        pos += len;
+    }
+    CHECK(pos == length);
+    CHECK(buffer.readPosition() == length);
+
+    // random access right around a boundary
+    std::vector<sam_t> around(64);
+    buffer.copy(chunkSamples - 32, around.data(), around.size());
+    for (size_t i = 0; i < around.size(); ++i) CHECK(std::fabs(around[i] - sampleAt(chunkSamples - 32 + i)) <= tolerance);
+
+    // mixes with a gain per frame onto existing samples
+    FileBuffer<sam_t> mixed(tCompact, pool);
+    mixed.resize(length);
+    fill(mixed, length, tSpans);
+    std::vector<float> gain(block.size() / kChannels);
+    for (size_t i = 0; i < gain.size(); ++i) gain[i] = static_cast<float>(i) / gain.size();
+    pos = 0;
+    while (true) {
+        std::fill(block.begin(), block.end(), 0.25f);
+        auto len = mixed.mix(block.data(), block.size(), gain.data(), kChannels);
+        if (len == 0) break;
+        for (size_t i = 0; i < len; ++i) CHECK(std::fabs(block[i] - (0.25f + sampleAt(pos + i) * gain[i / kChannels])) <= tolerance + 1e-6f);
+        pos += len;
+    }
+    CHECK(pos == length);
+
+    // a new load of the same expected length keeps the chunks, an empty buffer returns them to the pool
+    buffer.resize(length);
+    CHECK(buffer.writePosition() == 0);
+    CHECK(buffer.read(block.data(), block.size()) == 0);
+    CHECK(buffer.memorySize() == 3 * util::ChunkPool::kChunkSize);
+    buffer.resize(0);
+    CHECK(buffer.memorySize() == 0);
+}
+
+int main() {
+    testBuffer(false, false);
+    testBuffer(false, true);
+    testBuffer(true, false);
+    return castor::test::result();
+}
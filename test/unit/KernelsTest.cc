@@ -0,0 +1,92 @@
+/*
+ *  Copyright (C) 2024-2025 Christoph Pastl
+ *
+ *  This file is part of Castor.
+ *
+ *  Castor is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Castor is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ *  If you use this program over a network, you must also offer access
+ *  to the source code under the terms of the GNU Lesser General Public License.
+ */
+
+
+// Int16 kernels of every dispatch target the CPU supports against the scalar reference,
+// with lengths that leave a scalar tail and samples beyond full scale.
+
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+#include "dsp/Kernels.hpp"
+#include "check.hpp"
+
+using namespace castor::audio;
+using namespace castor::audio::kernels;
+
+struct Int16Kernels {
+    const char* name;
+    void (*toInt16)(int16_t*, const sam_t*, size_t);
+    void (*fromInt16)(sam_t*, const int16_t*, size_t);
+    void (*mixRampInt16)(sam_t*, const int16_t*, size_t, const float*, size_t);
+};
+
+static void testTarget(const Int16Kernels& tKernels) {
+    std::printf("testing %s\n", tKernels.name);
+    std::mt19937 random(1);
+    std::uniform_real_distribution<float> sample(-1.2f, 1.2f);
+
+    for (size_t n : {0, 1, 7, 8, 15, 16, 17, 33, 1037}) {
+        std::vector<sam_t> src(n);
+        for (auto& s : src) s = sample(random);
+        if (n > 2) {
+            src[0] = 1.0f;
+            src[1] = -1.0f;
+            src[2] = 0.5f / kInt16Scale; // rounding tie
+        }
+
+        std::vector<int16_t> packed(n), expectedPacked(n);
+        tKernels.toInt16(packed.data(), src.data(), n);
+        scalar::toInt16(expectedPacked.data(), src.data(), n);
+        for (size_t i = 0; i < n; ++i) CHECK(packed[i] == expectedPacked[i]);
+
+        std::vector<sam_t> unpacked(n), expectedUnpacked(n);
+        tKernels.fromInt16(unpacked.data(), expectedPacked.data(), n);
+        scalar::fromInt16(expectedUnpacked.data(), expectedPacked.data(), n);
+        for (size_t i = 0; i < n; ++i) CHECK(unpacked[i] == expectedUnpacked[i]);
+
+        for (size_t ch : {1, 2, 3}) {
+            std::vector<float> env(n / ch + 1);
+            for (size_t i = 0; i < env.size(); ++i) env[i] = static_cast<float>(i) / env.size();
+            std::vector<sam_t> mixed(n, 0.25f), expectedMixed(n, 0.25f);
+            auto frames = n - n % ch;
+            tKernels.mixRampInt16(mixed.data(), expectedPacked.data(), frames, env.data(), ch);
+            scalar::mixRampInt16(expectedMixed.data(), expectedPacked.data(), frames, env.data(), ch);
+            for (size_t i = 0; i < n; ++i) CHECK(std::fabs(mixed[i] - expectedMixed[i]) <= 1e-6f); // fused multiply-add may round differently
+        }
+    }
+}
+
+int main() {
+    std::printf("selected %s\n", isa());
+    testTarget({"scalar", scalar::toInt16, scalar::fromInt16, scalar::mixRampInt16});
+    #if CASTOR_KERNELS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2")) testTarget({"sse2", sse2::toInt16, sse2::fromInt16, sse2::mixRampInt16});
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) testTarget({"avx2", avx2::toInt16, avx2::fromInt16, avx2::mixRampInt16});
+    if (__builtin_cpu_supports("avx512f")) testTarget({"avx512", avx512::toInt16, avx512::fromInt16, avx512::mixRampInt16});
+    #elif CASTOR_KERNELS_NEON
+    testTarget({"neon", neon::toInt16, neon::fromInt16, neon::mixRampInt16});
+    #endif
+    return castor::test::result();
+}
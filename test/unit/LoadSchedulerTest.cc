@@ -0,0 +1,163 @@
+/*
+ *  Copyright (C) 2024-2025 Christoph Pastl
+ *
+ *  This file is part of Castor.
+ *
+ *  Castor is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Castor is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ *  If you use this program over a network, you must also offer access
+ *  to the source code under the terms of the GNU Lesser General Public License.
+ */
+
+
+// LoadScheduler ordering (earliest start first) and preemption of background loads by urgent ones.
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "api/API.hpp" // PlayItem, included ahead of the players as in Castor.hpp
+#include "LoadScheduler.hpp"
+#include "check.hpp"
+
+using namespace castor;
+
+static const audio::AudioStreamFormat kFormat(44100, 1024, 2);
+
+// records its loads; a held load blocks until released or cancelled
+class TestPlayer : public audio::Player {
+    std::atomic<bool> mCancelled = false;
+
+public:
+    static inline std::mutex sMutex;
+    static inline std::vector<std::string> sLoads;
+
+    std::atomic<bool> hold = false;
+    std::atomic<int> holdAttempts = 1; // loads held (or cancelled) before one goes through
+    std::atomic<int> attempts = 0;
+
+    TestPlayer(const std::string& tURI, time_t tStartIn) :
+        audio::Player(kFormat, tURI, 86400)
+    {
+        auto start = util::EngineClock::time() + tStartIn;
+        playItem = std::make_shared<PlayItem>(start, start + 600, tURI);
+        state = WAIT;
+        isScheduling = true; // as if scheduled by the engine
+    }
+
+    void load(const std::string& tURL, double tPosition) override {
+        mCancelled = false;
+        {
+            std::lock_guard<std::mutex> lock(sMutex);
+            sLoads.push_back(tURL);
+        }
+        if (attempts++ >= holdAttempts) return;
+        while (hold && !mCancelled) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        if (mCancelled) throw std::runtime_error("cancelled");
+    }
+
+    void cancelLoad() override {
+        audio::Player::cancelLoad();
+        mCancelled = true;
+    }
+
+    size_t process(const audio::sam_t* in, audio::sam_t* out, size_t nframes) override {
+        return 0;
+    }
+
+    static std::vector<std::string> loads() {
+        std::lock_guard<std::mutex> lock(sMutex);
+        return sLoads;
+    }
+
+    static void clearLoads() {
+        std::lock_guard<std::mutex> lock(sMutex);
+        sLoads.clear();
+    }
+};
+
+static bool started(const std::string& tURI, size_t tCount = 1) {
+    auto loads = TestPlayer::loads();
+    return static_cast<size_t>(std::count(loads.begin(), loads.end(), tURI)) >= tCount;
+}
+
+static void testEarliestStartFirst() {
+    std::printf("testing earliest start first\n");
+    TestPlayer::clearLoads();
+    LoadScheduler scheduler(1, 1);
+    auto blocker = std::make_shared<TestPlayer>("/tmp/castor-test/blocker", 3600);
+    blocker->hold = true;
+    scheduler.submit(blocker);
+    CHECK(test::waitFor([&] { return started("/tmp/castor-test/blocker"); }));
+
+    auto late = std::make_shared<TestPlayer>("/tmp/castor-test/late", 3000);
+    auto early = std::make_shared<TestPlayer>("/tmp/castor-test/early", 1000);
+    auto middle = std::make_shared<TestPlayer>("/tmp/castor-test/middle", 2000);
+    scheduler.submit(late);
+    scheduler.submit(early);
+    scheduler.submit(middle);
+    scheduler.submit(early); // queued once only
+    blocker->hold = false;
+
+    CHECK(test::waitFor([&] { return late->isLoaded && early->isLoaded && middle->isLoaded; }));
+    auto loads = TestPlayer::loads();
+    std::vector<std::string> expected = {"/tmp/castor-test/blocker", "/tmp/castor-test/early", "/tmp/castor-test/middle", "/tmp/castor-test/late"};
+    CHECK(loads == expected);
+    CHECK(scheduler.getJSON()["preemptions"] == 0);
+}
+
+static void testPreemption() {
+    std::printf("testing preemption\n");
+    TestPlayer::clearLoads();
+    LoadScheduler scheduler(1, 1);
+
+    // a background load gives way to an urgent one and is loaded again afterwards
+    auto background = std::make_shared<TestPlayer>("/tmp/castor-test/background", 1800);
+    background->hold = true;
+    scheduler.submit(background);
+    CHECK(test::waitFor([&] { return started("/tmp/castor-test/background"); }));
+    auto urgent = std::make_shared<TestPlayer>("/tmp/castor-test/urgent", 10);
+    scheduler.submit(urgent);
+    CHECK(test::waitFor([&] { return urgent->isLoaded && background->isLoaded; }));
+    auto loads = TestPlayer::loads();
+    std::vector<std::string> expected = {"/tmp/castor-test/background", "/tmp/castor-test/urgent", "/tmp/castor-test/background"};
+    CHECK(loads == expected);
+    CHECK(background->attempts == 2);
+    CHECK(scheduler.getJSON()["preemptions"] == 1);
+
+    // a load starting soon itself is not preempted, the urgent one waits for it
+    TestPlayer::clearLoads();
+    auto soon = std::make_shared<TestPlayer>("/tmp/castor-test/soon", 120);
+    soon->hold = true;
+    scheduler.submit(soon);
+    CHECK(test::waitFor([&] { return started("/tmp/castor-test/soon"); }));
+    auto waiting = std::make_shared<TestPlayer>("/tmp/castor-test/waiting", 10);
+    scheduler.submit(waiting);
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    CHECK(!waiting->isLoaded);
+    CHECK(!started("/tmp/castor-test/waiting"));
+    soon->hold = false;
+    CHECK(test::waitFor([&] { return soon->isLoaded && waiting->isLoaded; }));
+    CHECK(soon->attempts == 1);
+    CHECK(scheduler.getJSON()["preemptions"] == 1);
+}
+
+int main() {
+    testEarliestStartFirst();
+    testPreemption();
+    return castor::test::result();
+}
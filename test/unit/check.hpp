@@ -0,0 +1,64 @@
+/*
+ *  Copyright (C) 2024-2025 Christoph Pastl
+ *
+ *  This file is part of Castor.
+ *
+ *  Castor is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Castor is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ *  If you use this program over a network, you must also offer access
+ *  to the source code under the terms of the GNU Lesser General Public License.
+ */
+
+
+
+#pragma once
+
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <thread>
+
+// Minimal assertions for the unit tests (no test framework is required): failed checks are reported
+// with their location and counted, main returns the result to ctest.
+
+namespace castor {
+namespace test {
+
+inline int sFailures = 0;
+
+inline int result() {
+    if (sFailures) std::fprintf(stderr, "%d check(s) failed\n", sFailures);
+    return sFailures ? 1 : 0;
+}
+
+// polls tCondition until it holds or tTimeout passes
+inline bool waitFor(const std::function<bool()>& tCondition, std::chrono::milliseconds tTimeout = std::chrono::seconds(5)) {
+    auto end = std::chrono::steady_clock::now() + tTimeout;
+    while (!tCondition()) {
+        if (std::chrono::steady_clock::now() > end) return false;
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    return true;
+}
+
+}
+}
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            std::fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #cond); \
+            ++castor::test::sFailures; \
+        } \
+    } while (0)